@@ -10,85 +10,114 @@ using namespace cv;
 
 
 AppleDetector::AppleDetector() {
+	//tresholds for the orange HSV values
+	const int orangeLow[3] = {0, 90, 80};
+	const int orangeHigh[3] = {50, 255, 255};
+	//tresholds for the white HSV values
+	const int whiteLow[3] = {30, 0, 100};
+	const int whiteHigh[3] = {255, 40, 255};
+	colorLut.setClass(ORANGE_APPLE, orangeLow, orangeHigh);
+	colorLut.setClass(WHITE_APPLE, whiteLow, whiteHigh);
 }
 
 vector<Vec3f> AppleDetector::getCircles(Mat tresholded) {
+	//pixel count in any rectangle from the integral image
+	integral(tresholded, maskSum, CV_32S);
+	return fillFilter(circles);
+}
+
+vector<Vec3f> AppleDetector::fillFilter(const vector<Vec3f> & candidates) {
 	vector<Vec3f> goodCircles;
+	//integral image is one larger than the mask
+	Rect image(0, 0, maskSum.cols - 1, maskSum.rows - 1);
 
-	for (size_t i = 0; i < circles.size(); i++) {
-		Vec3i c = circles[i];
-		//Point center = Point(c[0], c[1]);
+	for (size_t i = 0; i < candidates.size(); i++) {
+		Vec3i c = candidates[i];
 		int radius = c[2];
 		int left_x = c[0] - radius;
 		int left_y = c[1] - radius;
 
-		Rect crop(left_x, left_y, (2*radius), (2 * radius));
-		
-		Mat res = tresholded(crop);
-
-		int white = countNonZero(res);
-		int full = res.rows * res.cols;
-		//cout << "white: " << res.rows;
-		//cout << "full: " << res.cols;
+		//square around the circle (the part inside the image)
+		Rect crop = Rect(left_x, left_y, (2*radius), (2 * radius)) & image;
+		if (crop.area() == 0)
+			continue;
+		int x2 = crop.x + crop.width;
+		int y2 = crop.y + crop.height;
+		int sum = maskSum.at<int>(y2, x2) - maskSum.at<int>(crop.y, x2)
+			- maskSum.at<int>(y2, crop.x) + maskSum.at<int>(crop.y, crop.x);
+		//mask pixels are 255
+		int white = sum / 255;
+		int full = crop.area();
 		float percentage = ((float)white / (float)full * 100);
-		//int black = (res.rows * res.cols) - white;
 
 		if (percentage > 50) {
 			goodCircles.push_back(c);
 			//cout << "percentage: " << percentage << " radius: " << radius << endl;
-			//imshow("Display window", res);
-			//waitKey(0);
 		}
 	}
 
 	return goodCircles;
 }
 
+void AppleDetector::findCircles(Mat gray, bool small) {
+	//two passes as before, the Vec4f votes from HOUGH_GRADIENT are the radius support,
+	//not the centre accumulator threshold, and one pass keeps one radius for each centre,
+	//so one pass does not give the same circles
+	if (small) {
+		HoughCircles(gray, smallCircles, HOUGH_GRADIENT, 1, 18, 180, 18, 10, 25);
+	}
+	else {
+		HoughCircles(gray, bigCircles, HOUGH_GRADIENT, 1, 38, 180, 24, 20, 60);
+	}
+}
+
+Mat AppleDetector::circlesMask(const vector<Vec3f> & found, Size size) {
+	//filled circles
+	Mat mask = cv::Mat::zeros(size.height, size.width, CV_8UC1);
+	for (size_t i = 0; i < found.size(); i++) {
+		Vec3i c = found[i];
+		circle(mask, Point(c[0], c[1]), c[2], Scalar(255, 255, 255), -1, 8, 0);
+	}
+	return mask;
+}
+
 Mat AppleDetector::getCirclesMask(Mat gray, bool small) {
 	//detect circles in a gray image
-	////vector<Vec3f> circles;
-	//HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 25, 100, 30, 10, 30);
-	//HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 25);
-	//HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 50, 90, 30, 20, 80);
-	// //good one
-	//HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 10, 200, 25, 2, 35);
-	/////HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 20, 230, 20, 10, 35);
-	//HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 10, 120, 12, 2, 10);
-	HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 18, 180, 18, 10, 25);//small
-	//HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 38, 180, 28, 20, 40);//big
-
+	findCircles(gray, small);
 	if (small) {
-		HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 18, 180, 18, 10, 25);
+		circles = smallCircles;
 	}
 	else {
-		HoughCircles(gray, circles, HOUGH_GRADIENT, 1, 38, 180, 24, 20, 60);
+		circles = bigCircles;
 	}
 
 	//create mask => used for getting the new hsv image only with the detected circles
-	Mat mask = cv::Mat::zeros(gray.rows, gray.cols, CV_8UC1);
-	medianBlur(gray, gray, 3 );
-	//loop through the circles
-	for (size_t i = 0; i < circles.size(); i++) {
-		Vec3i c = circles[i];
-		Point center = Point(c[0], c[1]);
-		int radius = c[2];
-		circle(gray, center, radius, Scalar(255, 0, 255), 3, LINE_AA); //draw found circles on the gray image - for debugging
-		circle(mask, center, radius, Scalar(255, 255, 255), -1, 8, 0); //draw circles on the mask
-	}
-	return mask;
+	return circlesMask(circles, Size(gray.cols, gray.rows));
 }
 
-Mat imageReducer(Mat gray, int percentage) {
-	//turnes percentage of the rows black in a top-down approach
-	int noOfRows = int(gray.rows / 100 * percentage);
-	for (int y = gray.rows; y > (gray.rows - noOfRows); y--) {
-		for (int x = 0; x < gray.cols; x++)
-		{
-			gray.at<bool>(y, x) = 0;
-		}
+Mat imageReducer(Mat image, int percentage) {
+	//leaves out percentage of the rows at the bottom of the image,
+	//returns a view (no copy), so pixel positions are unchanged
+	int noOfRows = int(image.rows / 100 * percentage);
+	return image(Range(0, image.rows - noOfRows), Range::all());
+}
+
+void AppleDetector::setDebugDump(UImageSaver * saver, float interval) {
+	dumpSaver = saver;
+	dumpInterval = interval;
+}
+
+void AppleDetector::debugDump(const Mat & im, const char * name) {
+	if (dumpSaver == NULL || dumpTime.getTimePassed() < dumpInterval) {
+		return;
 	}
-	imwrite("reduced.jpg", gray);
-	return gray;
+	dumpTime.now();
+	char date[25];
+	char filename[64];
+	dumpTime.getForFilename(date);
+	snprintf(filename, 64, "%s_%s", name, date);
+	//saved in the image saver thread, dropped if the saver is busy
+	dumpSaver->save(im, filename);
 }
 
 Mat AppleDetector::findWhiteApples(Mat image) {
@@ -97,35 +126,23 @@ Mat AppleDetector::findWhiteApples(Mat image) {
 		Mat img = image;
 		Mat gray;
 		Mat tresholded;
-		Mat hsv;
 		Mat mask;
-		Mat mapped;
 		Mat output;
 
-		//tresholds for the white HSV values
-		int wLowH = 30;
-		int wHighH = 255;
-
-		int wLowS = 0;
-		int wHighS = 40;
-
-		int wLowV = 100;
-		int wHighV = 255;
+		//remove lower x % of the picture
+		img = imageReducer(img, 40);
 
 		cvtColor(img, gray, COLOR_BGR2GRAY);
-		cvtColor(img, hsv, COLOR_BGR2HSV);
-
-		//remove upper x % of the picture
-		gray = imageReducer(gray, 40);
+		//HSV treshold for the white apple colour (and the other apple colours) in one pass
+		colorLut.classify(img, labels);
+		debugDump(gray, "reduced");
 
 		//get mask of found circles
 		mask = getCirclesMask(gray, true);
 
-		//create mapped image from the original hsv using the mask
-		hsv.copyTo(mapped, mask);
-
-		//treshold the mapped image using the tresholds
-		inRange(mapped, Scalar(wLowH, wLowS, wLowV), Scalar(wHighH, wHighS, wHighV), tresholded);
+		//white pixels inside the found circles only
+		UColorLut::classMask(labels, WHITE_APPLE, tresholded);
+		bitwise_and(tresholded, mask, tresholded);
 
 		//create structuring elements for the morphological operations
 		Mat horizontalElement = getStructuringElement(MORPH_RECT, Size(1, 7), Point(-1, -1));
@@ -147,46 +164,41 @@ Mat AppleDetector::findOrangeApples(Mat image, bool small) {
 	Mat img = image;
 	Mat gray;
 	Mat tresholded;
-	Mat hsv;
 	Mat mask;
-	Mat mapped;
 	Mat output;
 
-	//tresholds for the orange HSV values
-	int lowH = 0;
-	int highH = 50;
-
-	int lowS = 90;
-	int highS = 255;
-
-	int lowV = 80;
-	int highV = 255;
+	//remove lower x % of the picture
+	img = imageReducer(img, 30);
 
 	cvtColor(img, gray, COLOR_BGR2GRAY);
 	//Mat bgr[3];
 	//split(image, bgr);
 	//gray = bgr[2];
-	cvtColor(img, hsv, COLOR_BGR2HSV);
-
-	//remove upper x % of the picture
-	gray = imageReducer(gray, 30);
+	//HSV treshold for the orange apple colour (and the other apple colours) in one pass
+	colorLut.classify(img, labels);
+	debugDump(gray, "reduced");
 
 	//get mask of found circles
 	mask = getCirclesMask(gray, small);
 	//return mask; 
-	//create mapped image from the original hsv using the mask
-	hsv.copyTo(mapped, mask);
+	output = orangeInCircles(mask);
+	
+	//imshow("Display window", output);
+	return output;
+}
 
-	//treshold the mapped image using the tresholds
-	inRange(mapped, Scalar(lowH, lowS, lowV), Scalar(highH, highS, highV), tresholded);
+Mat AppleDetector::orangeInCircles(Mat circleMask) {
+	Mat tresholded;
+	Mat output;
+	//orange pixels inside the found circles only
+	UColorLut::classMask(labels, ORANGE_APPLE, tresholded);
+	bitwise_and(tresholded, circleMask, tresholded);
 	
 	//create structuring elements for the morphological operations
 	Mat circleElement = getStructuringElement(MORPH_ELLIPSE, Size(11, 11), Point(-1, -1));
 	
 	//CLOSING - filling in the holes
 	morphologyEx(tresholded, output, MORPH_CLOSE, circleElement, Point(-1, -1), 2);
-	
-	//imshow("Display window", output);
 	return output;
 }
 
@@ -208,13 +220,25 @@ pose_t AppleDetector::getOrangeApplePose(Mat image) {
 	pose_t orange_apple_pose;
 	orange_apple_pose.valid = false;
 
-	//Search for big balls first
-	Mat res = findOrangeApples(image, false);
-	vector<Vec3f> resultVector = getCircles(res);
+	//colour once for both apple sizes
+	//remove lower x % of the picture
+	Mat img = imageReducer(image, 30);
+	Mat gray;
+	cvtColor(img, gray, COLOR_BGR2GRAY);
+	colorLut.classify(img, labels);
+	debugDump(gray, "reduced");
+
+	//Search for big balls first, fill ratio on a mask of the big circles only
+	findCircles(gray, false);
+	Mat res = orangeInCircles(circlesMask(bigCircles, Size(gray.cols, gray.rows)));
+	integral(res, maskSum, CV_32S);
+	vector<Vec3f> resultVector = fillFilter(bigCircles);
 	if (resultVector.empty()) {
 		//Search for small balls
-		Mat res = findOrangeApples(image, true);
-		resultVector = getCircles(res);
+		findCircles(gray, true);
+		res = orangeInCircles(circlesMask(smallCircles, Size(gray.cols, gray.rows)));
+		integral(res, maskSum, CV_32S);
+		resultVector = fillFilter(smallCircles);
 	}
 	else
 	{
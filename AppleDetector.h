@@ -5,6 +5,9 @@
 #include <string>
 
 #include "types.h"
+#include "ucolorlut.h"
+#include "uimagesaver.h"
+#include "utime.h"
 
 using namespace std;
 using namespace cv;
@@ -20,4 +23,31 @@ public:
 	Mat findOrangeApples2(Mat image);
 	pose_t getOrangeApplePose(Mat image);
 	float getDistance(int radius);
+	//opt-in debug dump of the reduced gray image, saved by the image saver threads,
+	//at most one image every interval seconds (saver NULL is off)
+	void setDebugDump(UImageSaver * saver, float interval = 1.0);
+private:
+	UImageSaver * dumpSaver = NULL;
+	float dumpInterval = 1.0;
+	UTime dumpTime;
+	void debugDump(const Mat & im, const char * name);
+	//colour classes (label bits) for the apples
+	static const int ORANGE_APPLE = 0;
+	static const int WHITE_APPLE = 1;
+	//HSV thresholds for all apple colours in one pass
+	UColorLut colorLut;
+	Mat labels;
+	//circles (x, y, radius) from the small and the big Hough pass
+	vector<Vec3f> smallCircles;
+	vector<Vec3f> bigCircles;
+	//integral image of the tresholded mask (for fill ratio)
+	Mat maskSum;
+	//find small (or big) circles
+	void findCircles(Mat gray, bool small);
+	//keep circles that are more than half filled (uses maskSum)
+	vector<Vec3f> fillFilter(const vector<Vec3f> & candidates);
+	//orange pixels inside the circle mask, closed (uses labels)
+	Mat orangeInCircles(Mat circleMask);
+	//mask with the circles filled
+	Mat circlesMask(const vector<Vec3f> & found, Size size);
 };
@@ -23,9 +23,15 @@ CVPositions::CVPositions()
     this->cam.options->video_height=700;
     this->cam.options->framerate=30;
     this->cam.options->verbose=true;
+
+    //ArUco position is in meters
+    arucoFilter[RED].tolerance = 0.05;
+    arucoFilter[WHITE].tolerance = 0.05;
 }
 
 CVPositions::~CVPositions() {
+    // stop capture thread before the camera is destroyed
+    stop();
 }
 
 void CVPositions::init(bool show_stream,bool save_video) 
@@ -36,24 +42,85 @@ void CVPositions::init(bool show_stream,bool save_video)
     }
     if (save_video) {
         this->save = true;
-        this->video.open("outcpp.avi", VideoWriter::fourcc('M','J','P','G'), 10, Size(932,700),true);
+        // encoded in recorder thread, so mission timing is unchanged
+        this->recorder.open("outcpp", Size(932,700), 10);
     }
     this->cam.startVideo();
+    // frames left in the mailbox from before a shutdown() are stale
+    sessionStart.now();
+    // capture thread
+    start();
+    pool.start(detectThreads);
+}
+
+void CVPositions::run()
+{
+    while (!th1stop) {
+        CVFrame & f = frames.writeSlot();
+        if(!this->cam.getVideoFrame(f.image,1000)){
+            std::cout<<"Timeout error"<<std::endl;
+            timeoutCnt++;
+            continue;
+        }
+        // lccv gives no sensor timestamp, so this is the time the frame is received
+        f.time.now();
+        f.number = ++captureCnt;
+        frames.publish();
+        // wake a detector waiting for a fresh frame
+        std::lock_guard<std::mutex> lock(frameLock);
+        newFrame.notify_all();
+    }
+}
+
+bool CVPositions::getFrame(bool fresh)
+{
+    if (fresh) {
+        // wait for a frame captured after now
+        UTime t;
+        t.now();
+        std::unique_lock<std::mutex> lock(frameLock);
+        while (!frames.take() || frames.readSlot().time < t) {
+            if (newFrame.wait_for(lock, std::chrono::seconds(1)) == std::cv_status::timeout) {
+                std::cout<<"Timeout error"<<std::endl;
+                return false;
+            }
+        }
+    }
+    frames.take();
+    CVFrame & f = frames.readSlot();
+    if (f.number == 0 || f.time < sessionStart) {
+        // no frame since init()
+        return false;
+    }
+    image = f.image;
+    imageTime = f.time;
+    frameNumber = f.number;
+    return true;
+}
+
+cv::Mat & CVPositions::drawImage()
+{
+    image.copyTo(output);
+    return output;
 }
 
 void CVPositions::shutdown(void) 
 {
+    // stop capture thread first
+    stop();
+    pool.stop();
     cam.stopVideo();
 
     if(this->stream) {
         cv::destroyWindow("Aruco");
     }
     if(this->save) {
-        video.release();
+        recorder.close();
+        recorder.printStatus();
     }
 }
 
-pose_t CVPositions::find_aruco_pose(bool which_aruco)
+pose_t CVPositions::find_aruco_pose(bool which_aruco, bool fresh)
 {
     /*
     if (which_aruco == WHITE) {
@@ -63,21 +130,80 @@ pose_t CVPositions::find_aruco_pose(bool which_aruco)
         std::cout<<"Searching for orange aruco"<<std::endl;
     } */
 
-    pose_t aruco_location;
+    pose_t aruco_location = pose_t();
 
-    if(!this->cam.getVideoFrame(image,1000)){
-        std::cout<<"Timeout error"<<std::endl;
+    if(!getFrame(fresh)){
+        return aruco_location;
     }
-    else {
-        aruco_location = ar_finder.find_aruco(&image,true, which_aruco);
-        
+    if (arucoResult.frame == frameNumber && arucoResult.which == which_aruco) {
+        // no new frame
+        return arucoResult.pose;
+    }
+    if(this->stream || this->save) {
+        // markers are drawn on a copy, the frame may be used by the next detector
+        aruco_location = ar_finder.find_aruco(&drawImage(),true, which_aruco);
         if(this->save) {
-            this->video.write(image);
+            this->recorder.add(output);
         }
     }
+    else {
+        aruco_location = ar_finder.find_aruco(&image,false, which_aruco);
+    }
+    arucoResult.pose = aruco_location;
+    arucoResult.frame = frameNumber;
+    arucoResult.which = which_aruco;
     return aruco_location;
 }
 
+CVScene CVPositions::detect(int detections, bool which_aruco, bool fresh)
+{
+    CVScene scene;
+    UTime t;
+    t.now();
+
+    if(!getFrame(fresh)){
+        return scene;
+    }
+    scene.frame = frameNumber;
+    scene.time = imageTime;
+    scene.detections = detections;
+    // all detectors read the same image, so none may draw on it
+    if (detections & DETECT_ARUCO) {
+        pool.add([this, &scene, which_aruco]{
+            scene.aruco = ar_finder.find_aruco(&image, false, which_aruco);
+        });
+    }
+    bool balls = detections & (DETECT_ORANGE_BALLS | DETECT_WHITE_BALLS);
+    bool trunk = detections & DETECT_TRUNK;
+    if (balls || trunk) {
+        // blur and colour classes once for all ball and trunk detectors
+        ball_finder.prepare(image, balls, trunk, ballFrame);
+    }
+    if (detections & DETECT_ORANGE_BALLS) {
+        pool.add([this, &scene]{
+            scene.orangeCnt = ball_finder.ballsIn(ballFrame, RED, sceneBlobs[0], scene.orangeBalls);
+            scene.treeColor = BallFinder::treeColor(scene.orangeCnt);
+        });
+    }
+    if (detections & DETECT_WHITE_BALLS) {
+        pool.add([this, &scene]{
+            scene.whiteCnt = ball_finder.ballsIn(ballFrame, WHITE, sceneBlobs[1], scene.whiteBalls);
+        });
+    }
+    if (trunk) {
+        pool.add([this, &scene]{
+            scene.trunk = ball_finder.trunkIn(ballFrame, sceneBlobs[2]);
+        });
+    }
+    pool.wait();
+
+    if(this->save) {
+        this->recorder.add(image);
+    }
+    scene.ms = t.getTimePassed() * 1000;
+    return scene;
+}
+
 pose_t CVPositions::find_apple_pose(bool which_color)
 {
     if (which_color == WHITE) {
@@ -91,8 +217,8 @@ pose_t CVPositions::find_apple_pose(bool which_color)
     int ch=0;
 
     while(ch!=27){
-        if(!this->cam.getVideoFrame(image,1000)){
-            std::cout<<"Timeout error"<<std::endl;
+        if(!getFrame(true)){
+            continue;
         }
         else {
             if(which_color == RED) {
@@ -100,22 +226,23 @@ pose_t CVPositions::find_apple_pose(bool which_color)
             }
             
             if(this->stream) { 
+                cv::Mat & shown = drawImage();
                 if(apple_pose.valid) {
                     Point center = Point(apple_pose.x, apple_pose.y);
                     string text = to_string(apple_pose.z);
 
-                    circle(image, center, apple_pose.radius, Scalar(255, 0, 255), 3, LINE_AA);
+                    circle(shown, center, apple_pose.radius, Scalar(255, 0, 255), 3, LINE_AA);
                     
-                    putText(image,
+                    putText(shown,
                     text,
-                    Point(10, image.rows / 2), //top-left position
+                    Point(10, shown.rows / 2), //top-left position
                     FONT_HERSHEY_DUPLEX,
                     1.0,
                     CV_RGB(118, 185, 0), //font color
                     2);
                 }
     
-                cv::imshow("Video",image);
+                cv::imshow("Video",shown);
                 ch=cv::waitKey(10);
             }
 
@@ -129,7 +256,7 @@ pose_t CVPositions::find_apple_pose(bool which_color)
     return apple_pose;
 }
 
-pose_t CVPositions::treeID(bool which_color)
+pose_t CVPositions::treeID(bool which_color, bool fresh)
 {
     if (which_color == WHITE) {
         //std::cout<<"Searching for tree with white balls"<<std::endl;
@@ -138,33 +265,42 @@ pose_t CVPositions::treeID(bool which_color)
         //std::cout<<"Searching for tree with orange balls"<<std::endl;
     } 
 
-    pose_t treeColorPose;
+    pose_t treeColorPose = pose_t();
 
-    if(!this->cam.getVideoFrame(image,1000)){
-        std::cout<<"Timeout error"<<std::endl;
+    if(!getFrame(fresh)){
+        return treeColorPose;
+    }
+    else if (treeResult.frame == frameNumber && treeResult.which == which_color) {
+        // no new frame
+        return treeResult.pose;
     }
     else {
-        treeColorPose = ball_finder.treeID(image,which_color,false);
+        // the ball finder draws the balls, so use a copy of the frame
+        cv::Mat & shown = drawImage();
+        treeColorPose = ball_finder.treeID(shown,which_color,false);
+        treeResult.pose = treeColorPose;
+        treeResult.frame = frameNumber;
+        treeResult.which = which_color;
             
         if(this->stream) { 
             if(treeColorPose.valid) {
                 Point center = Point(treeColorPose.x, treeColorPose.y);
                 string text = to_string(treeColorPose.z);
 
-                circle(image, center, treeColorPose.radius, Scalar(255, 0, 255), 3, LINE_AA);
+                circle(shown, center, treeColorPose.radius, Scalar(255, 0, 255), 3, LINE_AA);
                 
-                putText(image,
+                putText(shown,
                 text,
-                Point(10, image.rows / 2), //top-left position
+                Point(10, shown.rows / 2), //top-left position
                 FONT_HERSHEY_DUPLEX,
                 1.0,
                 CV_RGB(118, 185, 0), //font color
                 2);
             }
-            cv::imshow("Video",image);
+            cv::imshow("Video",shown);
         }
         if(this->save) {
-            this->video.write(image);
+            this->recorder.add(shown);
         }
         
         if(treeColorPose.valid == true) {
@@ -187,23 +323,93 @@ pose_t CVPositions::treeID(bool which_color)
     return treeColorPose;
 }
 
-pose_t CVPositions::trunkPos(void)
+pose_t CVPositions::trunkPos(bool fresh)
 {
-    pose_t trunk_pos;
+    pose_t trunk_pos = pose_t();
 
-    if(!this->cam.getVideoFrame(image,1000)){
-        std::cout<<"Timeout error"<<std::endl;
+    if(!getFrame(fresh)){
+        return trunk_pos;
+    }
+    else if (trunkResult.frame == frameNumber) {
+        // no new frame
+        return trunkResult.pose;
     }
     else {
-        trunk_pos = ball_finder.trunkFinder(image,false);
+        // the trunk finder draws the trunk, so use a copy of the frame
+        cv::Mat & shown = drawImage();
+        trunk_pos = ball_finder.trunkFinder(shown,false);
+        trunkResult.pose = trunk_pos;
+        trunkResult.frame = frameNumber;
 
         if(this->save) {
-            this->video.write(image);
+            this->recorder.add(shown);
         }
     }
     return trunk_pos;
 }
 
+pose_t CVPositions::trunkPosFiltered(float & confidence, bool fresh)
+{
+    pose_t trunk_pos = trunkPos(fresh);
+    trunkFilter.update(trunk_pos, frameNumber, imageTime);
+    confidence = trunkFilter.confidence;
+    return trunkFilter.estimate;
+}
+
+int CVPositions::treeColorFiltered(float & confidence, bool fresh)
+{
+    pose_t result = treeID(RED, fresh);
+    int vote = -1;
+    if (result.valid) {
+        vote = result.id;
+    }
+    treeVotes.update(vote, frameNumber, imageTime);
+    confidence = treeVotes.confidence;
+    return treeVotes.best;
+}
+
+int CVPositions::treeColor(int maxFrames, float minConfidence, float & confidence, float maxTime)
+{
+    int color = -1;
+    int frames = 0;
+    UTime t;
+    t.now();
+    confidence = 0;
+    treeVotes.reset();
+    // no vote if no frame (camera timeout) or no tree is found
+    while (confidence < minConfidence && (frames < maxFrames || color < 0) &&
+           t.getTimePassed() < maxTime) {
+        color = treeColorFiltered(confidence);
+        frames++;
+    }
+    if (color < 0) {
+        std::cout << "Tree colour unknown after " << frames << " frames ("
+                  << t.getTimePassed() << " s)" << std::endl;
+    }
+    else if (confidence < minConfidence) {
+        std::cout << "Tree colour " << color << " not certain after " << frames
+                  << " frames (confidence " << confidence << "), using best vote" << std::endl;
+    }
+    return color;
+}
+
+pose_t CVPositions::arucoFiltered(bool which_aruco, float & confidence, bool fresh)
+{
+    pose_t aruco_pose = find_aruco_pose(which_aruco, fresh);
+    UPoseFilter & filter = arucoFilter[which_aruco];
+    filter.update(aruco_pose, frameNumber, imageTime);
+    confidence = filter.confidence;
+    return filter.estimate;
+}
+
+void CVPositions::resetFilters()
+{
+    trunkFilter.reset();
+    treeVotes.reset();
+    arucoFilter[RED].reset();
+    arucoFilter[WHITE].reset();
+}
+
 void CVPositions::determineMovement(pose_t object_position,bool &go_straight, bool &go_left, bool &go_right)
 {
     if(object_position.x < 480) {
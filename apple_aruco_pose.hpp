@@ -5,6 +5,14 @@
 #include "aruco.hpp"
 #include "AppleDetector.h"
 #include "balls.hpp"
+#include "utime.h"
+#include "urun.h"
+#include "umailbox.h"
+#include "utaskpool.h"
+#include "uvideorecorder.h"
+#include "utargetfilter.h"
+#include <mutex>
+#include <condition_variable>
 
 #include <lccv.hpp>
 #include <opencv2/opencv.hpp>
@@ -14,28 +22,126 @@ using namespace cv;
 #define RED 0
 #define WHITE 1
 
-class CVPositions
+// one camera frame in the capture mailbox
+struct CVFrame
+{
+    cv::Mat image;
+    // time the frame was received from the camera (some ms after capture)
+    UTime time;
+    int number = 0;
+};
+
+// the result of a detector for one frame
+struct CVResult
+{
+    pose_t pose = pose_t();
+    int frame = -1;
+    bool which = false;
+};
+
+// detections for CVPositions::detect() (bits, may be combined)
+#define DETECT_ARUCO 0x01
+#define DETECT_ORANGE_BALLS 0x02
+#define DETECT_WHITE_BALLS 0x04
+#define DETECT_TRUNK 0x08
+
+// results of several detectors on the same frame
+struct CVScene
+{
+    int frame = -1;         // frame number, -1 if no frame
+    UTime time;             // frame receive time (see CVFrame)
+    int detections = 0;     // requested detections
+    pose_t aruco = pose_t();
+    // largest ball of each colour and number of balls
+    pose_t orangeBalls = pose_t();
+    int orangeCnt = 0;
+    pose_t whiteBalls = pose_t();
+    int whiteCnt = 0;
+    // tree colour from number of orange balls (as treeID(RED)), -1 if unknown
+    int treeColor = -1;
+    pose_t trunk = pose_t();
+    // processing time (ms)
+    float ms = 0;
+};
+
+class CVPositions : public URun
 {
     public:
         CVPositions();
         ~CVPositions();
         void init(bool show_stream,bool save_video);
         void shutdown(void);
-        pose_t find_aruco_pose(bool which_aruco);
+        // detectors use the newest frame from the capture thread and return at once,
+        // if there is no new frame since last call, the last result is returned.
+        // with fresh=true, wait for a frame received after the call;
+        // the frame is shared by the detectors, so the detectors draw on a copy only
+        pose_t find_aruco_pose(bool which_aruco, bool fresh = false);
         pose_t find_apple_pose(bool which_color);
-        pose_t treeID(bool which_color);
-        pose_t trunkPos(void);
+        pose_t treeID(bool which_color, bool fresh = false);
+        pose_t trunkPos(bool fresh = false);
+        // several detections (DETECT_ bits) on the same frame,
+        // blur and colour classification is shared by the ball and trunk detectors,
+        // and the detectors run in parallel
+        CVScene detect(int detections, bool which_aruco = RED, bool fresh = false);
+        // filtered over frames (one state for each target) with a confidence 0..1,
+        // each frame is used once, so use fresh=true (or call once per frame)
+        pose_t trunkPosFiltered(float & confidence, bool fresh = true);
+        // tree colour (RED or WHITE) from votes of treeID(RED), -1 if unknown
+        int treeColorFiltered(float & confidence, bool fresh = true);
+        // tree colour (RED or WHITE) from new votes on fresh frames, until minConfidence
+        // or maxFrames, then the best so far is used; sampling goes on until there is a vote,
+        // but no longer than maxTime seconds, then -1 is returned
+        int treeColor(int maxFrames, float minConfidence, float & confidence, float maxTime = 10);
+        pose_t arucoFiltered(bool which_aruco, float & confidence, bool fresh = true);
+        // forget all targets (e.g. after the robot has moved)
+        void resetFilters();
         void determineMovement(pose_t object_position, bool &go_straight, bool &go_left, bool &go_right);
+        // capture thread, keeps the newest frame in the mailbox
+        void run();
+        // frames captured and capture timeouts
+        int captureCnt = 0;
+        int timeoutCnt = 0;
+        // worker threads for detect()
+        int detectThreads = 2;
+        // filter for each target, settings may be changed
+        UPoseFilter trunkFilter;
+        UVoteFilter treeVotes;
+        UPoseFilter arucoFilter[2];
+        // recorder for save_video, format and subsample may be set before init()
+        UVideoRecorder recorder;
     private:
+        // take newest frame to image (and imageTime),
+        // fresh: wait (up to 1 second) for a frame received after this call
+        // returns false if no frame is available
+        bool getFrame(bool fresh);
+        UMailbox<CVFrame> frames;
+        std::mutex frameLock;
+        std::condition_variable newFrame;
+        // last result for each detector
+        CVResult arucoResult;
+        CVResult treeResult;
+        CVResult trunkResult;
+        int frameNumber = -1;
+        // time of init(), older frames are not used
+        UTime sessionStart;
+        // for detect()
+        UTaskPool pool;
+        BallFrame ballFrame;
+        UBlobFinder sceneBlobs[3];
+
         Aruco_finder ar_finder;
         AppleDetector apple_detector;
         BallFinder ball_finder;
 
+        // the frame used by the detectors (shared, not to be changed)
         cv::Mat image;
+        // copy of image for detectors that draw, and for display
         cv::Mat output;
+        // copy image to output
+        cv::Mat & drawImage();
 
         lccv::PiCamera cam;
-        cv::VideoWriter video;
         bool stream = false;
         bool save = false;
+        UTime imageTime;
 };
\ No newline at end of file
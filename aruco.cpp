@@ -27,9 +27,8 @@ Aruco_finder::Aruco_finder()
 	aruco_pose.radius = 0;
     aruco_pose.id = 0;
     aruco_pose.valid = false;
-    
-    dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_100);
-
+    // no tracking (full search every frame), calls are irregular and there is
+    // no motion prediction, so the wanted marker could be missed
 }
 
 Aruco_finder::~Aruco_finder()
@@ -47,9 +46,6 @@ void Aruco_finder::set_markersize(float marker_size) {
 }
 pose_t Aruco_finder::find_aruco(cv::Mat *frame, bool show_image, bool red_or_white) {
 
-    Mat gray;
-    cvtColor(*frame, gray,COLOR_BGR2GRAY);
-
     vector<int> detectedIDs;
     
 	vector<vector<Point2f> > corners;
@@ -77,7 +73,7 @@ pose_t Aruco_finder::find_aruco(cv::Mat *frame, bool show_image, bool red_or_whi
         wanted_id = 5;
     }
 
-    aruco::detectMarkers(gray, dictionary, corners, detectedIDs); 
+    detector.detect(*frame, detectedIDs, corners);
 
     if (detectedIDs.size() > 0) { //We detected some markers
         //Estimate position of marker
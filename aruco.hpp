@@ -4,6 +4,7 @@
 #include <opencv2/aruco.hpp>
 
 #include "types.h"
+#include "uarucodetector.h"
 
 #define RED 0
 #define WHITE 1
@@ -24,7 +25,8 @@ class Aruco_finder
         Mat cameraMatrix;
 	    Mat distCoeffs;
         Mat R33 = Mat::eye(3,3,CV_64FC1);
-        cv::Ptr<cv::aruco::Dictionary> dictionary;
+        // dictionary, parameters and gray buffer reused for all frames
+        UArUcoDetector detector = UArUcoDetector(cv::aruco::DICT_4X4_100);
         double distance(double x, double y);
         float markerSize = 0.15;
 };
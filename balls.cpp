@@ -48,6 +48,21 @@ BallFinder::BallFinder()
     greenHSV.HSV_upper[0] = 60;
     greenHSV.HSV_upper[1] = 255;
     greenHSV.HSV_upper[2] = 255;
+    //Colour classes (label bits) for all colours
+    colorLut.setClass(RED, orangeHSV.HSV_lower, orangeHSV.HSV_upper);
+    colorLut.setClass(WHITE, whiteHSV.HSV_lower, whiteHSV.HSV_upper);
+    colorLut.setClass(GREEN, greenHSV.HSV_lower, greenHSV.HSV_upper);
+    //Ball count as with contours
+    ballFilter(blobFinder);
+}
+
+void BallFinder::ballFilter(UBlobFinder & blobs) {
+    //blobs in holes were not found (RETR_EXTERNAL)
+    blobs.outerOnly = true;
+    //approxPolyDP (3 pixels) gave no area for blobs less than about 6 pixels across
+    blobs.minArea = 30;
+    //or for thin lines
+    blobs.minCircularity = 0.2;
 }
 
 BallFinder::~BallFinder(){
@@ -56,11 +71,9 @@ BallFinder::~BallFinder(){
 
 pose_t BallFinder::find_ball(cv::Mat frame, bool red_or_white,bool debug) {
     Mat cropped;
-    Mat blurred;
     Mat mask;
     Mat mask_eroded;
     Mat mask_dilated;
-    Mat HSV;
 
     ballPose.valid = false;
 
@@ -74,15 +87,14 @@ pose_t BallFinder::find_ball(cv::Mat frame, bool red_or_white,bool debug) {
     //Blurred
     GaussianBlur(cropped,blurred,Size(11, 11),0);
 
-    cvtColor(blurred, HSV, COLOR_BGR2HSV);
+    //HSV threshold for all colours in one pass
+    colorLut.classify(blurred, labels);
 
     if (red_or_white == RED) {
-        inRange(HSV, Scalar (orangeHSV.HSV_lower[0],orangeHSV.HSV_lower[1],orangeHSV.HSV_lower[2]),
-    Scalar (orangeHSV.HSV_upper[0],orangeHSV.HSV_upper[1],orangeHSV.HSV_upper[2]),mask);
+        UColorLut::classMask(labels, RED, mask);
     }
     else if (red_or_white == WHITE){
-        inRange(HSV, Scalar (whiteHSV.HSV_lower[0],whiteHSV.HSV_lower[1],whiteHSV.HSV_lower[2]),
-    Scalar (whiteHSV.HSV_upper[0],whiteHSV.HSV_upper[1],whiteHSV.HSV_upper[2]),mask);
+        UColorLut::classMask(labels, WHITE, mask);
     }
 
     if (debug) {
@@ -111,39 +123,23 @@ pose_t BallFinder::find_ball(cv::Mat frame, bool red_or_white,bool debug) {
         waitKey(0);
     }
     
-    vector<vector<Point>> contours;
-    cv::findContours(mask_dilated,contours,RETR_EXTERNAL,CHAIN_APPROX_SIMPLE);
+    //All blobs in one pass, largest first
+    blobFinder.find(mask_dilated);
     //vector<Vec3f> contours;
     //HoughCircles(mask_dilated, contours, HOUGH_GRADIENT, 1, 18, 180, 18, 10, 25);
 
-    // Approximate contours to polygons + get bounding circles
-    vector<vector<Point> > contours_poly( contours.size() );
-    vector<Point2f>centers( contours.size() );
-    vector<float>radius( contours.size() );
-    
-    int idx = -1, max_area=0;
-    for( size_t i = 0; i < contours.size(); i++ ){
-        approxPolyDP( contours[i], contours_poly[i], 3, true );
-        minEnclosingCircle( contours_poly[i], centers[i], radius[i] );
-        int area = (int)contourArea(contours_poly[i]);     
-        if (area > max_area){
-            idx = (int)i;
-            max_area = area;
-        }
-    }
-
-  
-    if (idx>-1){
+    const UBlob * blob = blobFinder.largest();
+    if (blob != NULL){
         cout << "Ball detected!" << endl;
 
-        Point2f center = centers[idx];
-        circle( cropped, center, (int)radius[idx], Scalar(0,255,0), 2 );
+        Point2f center = blob->centroid;
+        circle( cropped, center, (int)blob->radius, Scalar(0,255,0), 2 );
         circle( cropped, center, 3, Scalar(255,0,0), -1 );
 
         ballPose.valid = true;
         ballPose.x = center.x;
         ballPose.y = center.y;
-        ballPose.z = getDistance((int)radius[idx]);
+        ballPose.z = getDistance((int)blob->radius);
     }
 
     if(debug) {
@@ -157,7 +153,7 @@ pose_t BallFinder::find_ball(cv::Mat frame, bool red_or_white,bool debug) {
     return ballPose;
 }
 
-float BallFinder::getDistance(int radius) {    
+float BallFinder::getDistance(int radius) const {    
 	int width_ball_pixels = radius * 2;
 	int f = 771.17;
 	float distance = ((width_ball_mm / width_ball_pixels) * f) / 10;
@@ -165,7 +161,7 @@ float BallFinder::getDistance(int radius) {
     return distance;
 }
 
-float BallFinder::getDistanceTree(int radius) {    
+float BallFinder::getDistanceTree(int radius) const {    
 	int width_ball_pixels = radius * 2;
 	int f = 771.17;
 	float distance = ((width_ball_mm / width_ball_pixels) * f) / 10;
@@ -207,11 +203,9 @@ Mat BallFinder::imageReducer(Mat image, int percentage,bool reverse, int width_p
 
 pose_t BallFinder::treeID(cv::Mat frame, bool red_or_white,bool debug) {
     Mat cropped;
-    Mat blurred;
     Mat mask;
     Mat mask_eroded;
     Mat mask_dilated;
-    Mat HSV;
 
     ballPose.valid = false;
 
@@ -225,15 +219,14 @@ pose_t BallFinder::treeID(cv::Mat frame, bool red_or_white,bool debug) {
     //Blurred
     GaussianBlur(cropped,blurred,Size(11, 11),0);
 
-    cvtColor(blurred, HSV, COLOR_BGR2HSV);
+    //HSV threshold for all colours in one pass
+    colorLut.classify(blurred, labels);
 
     if (red_or_white == RED) {
-        inRange(HSV, Scalar (orangeHSV.HSV_lower[0],orangeHSV.HSV_lower[1],orangeHSV.HSV_lower[2]),
-    Scalar (orangeHSV.HSV_upper[0],orangeHSV.HSV_upper[1],orangeHSV.HSV_upper[2]),mask);
+        UColorLut::classMask(labels, RED, mask);
     }
     else if (red_or_white == WHITE){
-        inRange(HSV, Scalar (whiteHSV.HSV_lower[0],whiteHSV.HSV_lower[1],whiteHSV.HSV_lower[2]),
-    Scalar (whiteHSV.HSV_upper[0],whiteHSV.HSV_upper[1],whiteHSV.HSV_upper[2]),mask);
+        UColorLut::classMask(labels, WHITE, mask);
     }
 
     if (debug) {
@@ -262,55 +255,27 @@ pose_t BallFinder::treeID(cv::Mat frame, bool red_or_white,bool debug) {
         waitKey(0);
     }
     
-    vector<vector<Point>> contours;
-    cv::findContours(mask_dilated,contours,RETR_EXTERNAL,CHAIN_APPROX_SIMPLE);
+    //All blobs in one pass (bounded number, largest first)
+    int ballCount = blobFinder.find(mask_dilated);
 
-    // Approximate contours to polygons + get bounding circles
-    vector<vector<Point> > contours_poly( contours.size() );
-    vector<Point2f>centers( contours.size() );
-    vector<float>radius( contours.size() );
-    
-    int ids[5] = {0};
-    int min_area=0;
-    int ballCount = 0;
-    for( size_t i = 0; i < contours.size(); i++ ){
-        approxPolyDP( contours[i], contours_poly[i], 3, true );
-        minEnclosingCircle( contours_poly[i], centers[i], radius[i] );
-        int area = (int)contourArea(contours_poly[i]);     
-        if (area > min_area){
-            ids[ballCount] = (int)i;
-            ballCount++;
-        }
-    }
-
-  
     if (ballCount>0){
         cout << ballCount << " ball(s) detected!" << endl;
-        int id = 0;
         for (int i  = 0; i < ballCount ; i++) {
-            id = ids[i];
-            Point2f center = centers[id];
-            circle( cropped, center, (int)radius[id], Scalar(0,255,0), 2 );
+            const UBlob & blob = blobFinder.blobs[i];
+            Point2f center = blob.centroid;
+            circle( cropped, center, (int)blob.radius, Scalar(0,255,0), 2 );
             circle( cropped, center, 3, Scalar(255,0,0), -1 );
 
             ballPose.valid = true;
             ballPose.x = center.x;
             ballPose.y = center.y;
-            ballPose.z = getDistance((int)radius[id]);
-        }
-        if (ballCount == 1) {
-            ballPose.id = WHITE;
-        }
-        else if (ballCount == 2 || ballCount == 3) {
-            ballPose.id = RED;
-        }
-        else {
-            ballPose.id = -1;
+            ballPose.z = getDistance((int)blob.radius);
         }
+        ballPose.id = treeColor(ballCount);
     }
     else if (ballCount == 0) {
         ballPose.valid = true;
-        ballPose.id = WHITE;
+        ballPose.id = treeColor(ballCount);
     }
 
     if(debug) {
@@ -327,11 +292,9 @@ pose_t BallFinder::treeID(cv::Mat frame, bool red_or_white,bool debug) {
 pose_t BallFinder::trunkFinder(cv::Mat frame,bool debug) {
     Mat cropped1;
     Mat cropped2;
-    Mat blurred;
     Mat mask;
     Mat mask_eroded;
     Mat mask_dilated;
-    Mat HSV;
 
     stubPose.valid = false;
 
@@ -351,10 +314,9 @@ pose_t BallFinder::trunkFinder(cv::Mat frame,bool debug) {
     //Blurred
     GaussianBlur(cropped2,blurred,Size(11, 11),0);
 
-    cvtColor(blurred, HSV, COLOR_BGR2HSV);
-
-    inRange(HSV, Scalar (greenHSV.HSV_lower[0],greenHSV.HSV_lower[1],greenHSV.HSV_lower[2]),
-    Scalar (greenHSV.HSV_upper[0],greenHSV.HSV_upper[1],greenHSV.HSV_upper[2]),mask);
+    //HSV threshold in one pass
+    colorLut.classify(blurred, labels);
+    UColorLut::classMask(labels, GREEN, mask);
 
     if (debug) {
         imshow("mask", mask);
@@ -382,35 +344,19 @@ pose_t BallFinder::trunkFinder(cv::Mat frame,bool debug) {
         waitKey(0);
     }
     
-    vector<vector<Point>> contours;
-    cv::findContours(mask_dilated,contours,RETR_EXTERNAL,CHAIN_APPROX_SIMPLE);
-
-    // Approximate contours to polygons + get bounding circles
-    vector<vector<Point> > contours_poly( contours.size() );
-    vector<Point2f>centers( contours.size() );
-    vector<float>radius( contours.size() );
-
-    int idx = -1, max_area=0;
-    for( size_t i = 0; i < contours.size(); i++ ){
-        approxPolyDP( contours[i], contours_poly[i], 3, true );
-        minEnclosingCircle( contours_poly[i], centers[i], radius[i] );
-        int area = (int)contourArea(contours_poly[i]);     
-        if (area > max_area){
-            idx = (int)i;
-            max_area = area;
-        }
-    }
+    //All blobs in one pass, largest first
+    trunkBlobs.find(mask_dilated);
 
-  
-    if (idx>-1){
-        Point2f center = centers[idx];
-        circle( cropped2, center, (int)radius[idx], Scalar(0,255,0), 2 );
+    const UBlob * blob = trunkBlobs.largest();
+    if (blob != NULL){
+        Point2f center = blob->centroid;
+        circle( cropped2, center, (int)blob->radius, Scalar(0,255,0), 2 );
         circle( cropped2, center, 3, Scalar(255,0,0), -1 );
 
         stubPose.valid = true;
         stubPose.x = center.x;
         stubPose.y = center.y;
-        stubPose.z = getDistanceTree((int)radius[idx]);
+        stubPose.z = getDistanceTree((int)blob->radius);
     }
 
     if(debug) {
@@ -421,4 +367,101 @@ pose_t BallFinder::trunkFinder(cv::Mat frame,bool debug) {
         destroyAllWindows(); //destroy all opened windows
     }
     return stubPose;
-}
\ No newline at end of file
+}
+
+int BallFinder::treeColor(int ballCount) {
+    if (ballCount == 0 || ballCount == 1) {
+        return WHITE;
+    }
+    else if (ballCount == 2 || ballCount == 3) {
+        return RED;
+    }
+    return -1;
+}
+
+Rect BallFinder::ballArea(Size size) const {
+    //Crop the top 20% (as imageReducer(frame,20,false,0))
+    int top = (size.height/100)*20;
+    return Rect(0, top, size.width, size.height - top);
+}
+
+Rect BallFinder::trunkArea(Size size) const {
+    //Bottom 65%, then top 60% and left 80% (as in trunkFinder)
+    int height = (size.height/100)*45;
+    int top = (height/100)*40;
+    int width = (size.width/100)*80;
+    return Rect(0, top, width, height - top);
+}
+
+void BallFinder::prepare(cv::Mat frame, bool balls, bool trunk, BallFrame & bf) {
+    Rect area;
+    if (balls) {
+        area = ballArea(frame.size());
+    }
+    if (trunk) {
+        if (balls) {
+            area = area | trunkArea(frame.size());
+        }
+        else {
+            area = trunkArea(frame.size());
+        }
+    }
+    bf.area = area;
+    bf.size = frame.size();
+    //Blurred and HSV threshold for all colours in one pass
+    GaussianBlur(frame(area),bf.blurred,Size(11, 11),0);
+    colorLut.classify(bf.blurred, bf.labels);
+}
+
+bool BallFinder::cleanMask(const BallFrame & bf, Rect area, int cls, int size, int shape, int erodeCnt, int dilateCnt, Mat & mask) const {
+    Mat eroded;
+    if ((area & bf.area) != area) {
+        cout << "Frame not prepared for this detector" << endl;
+        return false;
+    }
+    //Labels for area (relative to the prepared part)
+    Mat labels = bf.labels(area - bf.area.tl());
+    UColorLut::classMask(labels, cls, mask);
+    Mat element = getStructuringElement(shape, Size(size,size));
+    cv::erode(mask,eroded,element,Point(-1, -1), erodeCnt);
+    dilate(eroded,mask,element,Point(-1, -1), dilateCnt);
+    return true;
+}
+
+int BallFinder::ballsIn(const BallFrame & bf, bool red_or_white, UBlobFinder & blobs, pose_t & pose) const {
+    Mat mask;
+    pose.valid = false;
+    if (!cleanMask(bf, ballArea(bf.size), red_or_white, 11, MORPH_RECT, 2, 2, mask)) {
+        return 0;
+    }
+    ballFilter(blobs);
+    int ballCount = blobs.find(mask);
+    const UBlob * blob = blobs.largest();
+    if (blob != NULL){
+        pose.valid = true;
+        pose.x = blob->centroid.x;
+        pose.y = blob->centroid.y;
+        pose.z = getDistance((int)blob->radius);
+        pose.radius = (int)blob->radius;
+        pose.id = red_or_white;
+    }
+    return ballCount;
+}
+
+pose_t BallFinder::trunkIn(const BallFrame & bf, UBlobFinder & blobs) const {
+    Mat mask;
+    pose_t pose = pose_t();
+    if (!cleanMask(bf, trunkArea(bf.size), GREEN, 7, MORPH_ELLIPSE, 1, 2, mask)) {
+        return pose;
+    }
+    blobs.find(mask);
+    const UBlob * blob = blobs.largest();
+    if (blob != NULL){
+        pose.valid = true;
+        pose.x = blob->centroid.x;
+        pose.y = blob->centroid.y;
+        pose.z = getDistanceTree((int)blob->radius);
+        pose.radius = (int)blob->radius;
+    }
+    return pose;
+}
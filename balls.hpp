@@ -2,9 +2,12 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/core/core.hpp"
 #include "types.h"
+#include "ucolorlut.h"
+#include "ublobs.h"
 
 #define RED 0
 #define WHITE 1
+#define GREEN 2
 
 using namespace cv;
 using namespace std;
@@ -15,6 +18,15 @@ struct HSV
     int HSV_upper[3];
 };
 
+// intermediates shared by the detectors working on one frame
+struct BallFrame
+{
+    Mat blurred;    // blurred part of frame
+    Mat labels;     // colour class bits for blurred
+    Rect area;      // part of frame used
+    Size size;      // frame size
+};
+
 class BallFinder
 {
     public:
@@ -22,12 +34,33 @@ class BallFinder
         ~BallFinder();
         pose_t find_ball(cv::Mat frame, bool red_or_white, bool debug);
         Mat imageReducer(Mat image, int percentage,bool reverse, int width_percentage);
-        float getDistance(int radius);
-        float getDistanceTree(int radius);
+        float getDistance(int radius) const;
+        float getDistanceTree(int radius) const;
         pose_t treeID(cv::Mat frame, bool red_or_white, bool debug);
         pose_t trunkFinder(cv::Mat frame, bool debug);
         Mat imageReducerReverse(Mat image, int percentage);
+        // tree colour from the number of balls found with treeID
+        static int treeColor(int ballCount);
+        // blur and colour classify the part of frame needed for balls and/or trunk once,
+        // the detectors below may then run in parallel, each with its own blob finder
+        void prepare(cv::Mat frame, bool balls, bool trunk, BallFrame & bf);
+        // largest ball in a prepared frame (same coordinates as find_ball),
+        // returns number of balls, the blob filter is set as ballFilter()
+        int ballsIn(const BallFrame & bf, bool red_or_white, UBlobFinder & blobs, pose_t & pose) const;
+        // trunk in a prepared frame (same coordinates as trunkFinder)
+        pose_t trunkIn(const BallFrame & bf, UBlobFinder & blobs) const;
+        // blob filter for ball counting, blobs are counted as the contour version did
+        // (outer contours only, approximated polygon with an area), x,y is the blob centroid
+        // (was the enclosing circle centre)
+        static void ballFilter(UBlobFinder & blobs);
     private:
+        // part of frame used by find_ball and treeID
+        Rect ballArea(Size size) const;
+        // part of frame used by trunkFinder
+        Rect trunkArea(Size size) const;
+        // mask of a colour class in (part of) a prepared frame, after erode and dilate,
+        // returns false if area is not prepared
+        bool cleanMask(const BallFrame & bf, Rect area, int cls, int size, int shape, int erodeCnt, int dilateCnt, Mat & mask) const;
         pose_t ballPose;
         Mat cameraMatrix;
 	    Mat distCoeffs;
@@ -36,6 +69,14 @@ class BallFinder
         HSV greenHSV;
         pose_t stubPose;
         float width_ball_mm = 42;
+        // HSV thresholds for orange (RED), WHITE and GREEN in one pass
+        UColorLut colorLut;
+        // blob extraction with bounded storage, balls and trunk
+        UBlobFinder blobFinder;
+        UBlobFinder trunkBlobs;
+        // buffers reused for every frame
+        Mat blurred;
+        Mat labels;
 };
 
 
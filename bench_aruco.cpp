@@ -0,0 +1,130 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+/**
+ * Benchmark for ArUco detection, the same timing as the 'o' loop-test
+ * (average over 100 frames), run on a recorded frame set.
+ * Compares detection with a new dictionary and parameters for every
+ * frame (as before) with the long lived UArUcoDetector, with and without tracking,
+ * and with a coarse search for large markers.
+ *
+ * Usage: ./bench_aruco [image.png ...]
+ * frames are used in turn, without images a generated 1920x1080 frame with 4 markers is used. */
+
+#include <stdio.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include "uarucodetector.h"
+#include "utime.h"
+
+/** number of frames in the loop-test */
+static const int LOOP_CNT = 100;
+
+int main(int argc, char ** argv)
+{
+  std::vector<cv::Mat> frames;
+  for (int i = 1; i < argc; i++)
+  {
+    cv::Mat im = cv::imread(argv[i]);
+    if (im.empty())
+      printf("# failed to load %s\n", argv[i]);
+    else
+      frames.push_back(im);
+  }
+  if (frames.empty())
+  { // generated frame with markers of different size
+    cv::Mat gray(1080, 1920, CV_8UC1, cv::Scalar(160));
+    cv::Ptr<cv::aruco::Dictionary> dict = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+    const int size[] = {100, 150, 200, 300};
+    for (int i = 0; i < 4; i++)
+    {
+      cv::Mat marker;
+      cv::aruco::drawMarker(dict, i + 1, size[i], marker);
+      marker.copyTo(gray(cv::Rect(200 + i * 420, 300, size[i], size[i])));
+    }
+    cv::Mat im;
+    cv::cvtColor(gray, im, cv::COLOR_GRAY2BGR);
+    frames.push_back(im);
+    printf("# no images - using a generated %dx%d frame\n", im.cols, im.rows);
+  }
+  else
+    printf("# using %d recorded frames (%dx%d)\n", (int)frames.size(), frames[0].cols, frames[0].rows);
+  std::vector<int> ids;
+  std::vector<std::vector<cv::Point2f> > corners;
+  UTime t;
+  // before - dictionary and parameters for every frame, colour image to detector
+  int found = 0;
+  t.now();
+  for (int i = 0; i < LOOP_CNT; i++)
+  {
+    cv::Ptr<cv::aruco::Dictionary> dict = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+    cv::Ptr<cv::aruco::DetectorParameters> param = cv::aruco::DetectorParameters::create();
+    cv::aruco::detectMarkers(frames[i % frames.size()], dict, corners, ids, param);
+    found += ids.size();
+  }
+  float dt1 = t.getTimePassed();
+  // after - long lived detector
+  UArUcoDetector detector(cv::aruco::DICT_4X4_50);
+  int found2 = 0;
+  t.now();
+  for (int i = 0; i < LOOP_CNT; i++)
+    found2 += detector.detect(frames[i % frames.size()], ids, corners);
+  float dt2 = t.getTimePassed();
+  // same for gray frames (as the camera delivers for ArUco)
+  std::vector<cv::Mat> grays(frames.size());
+  for (unsigned int i = 0; i < frames.size(); i++)
+    cv::cvtColor(frames[i], grays[i], cv::COLOR_BGR2GRAY);
+  int found3 = 0;
+  t.now();
+  for (int i = 0; i < LOOP_CNT; i++)
+    found3 += detector.detect(grays[i % grays.size()], ids, corners);
+  float dt3 = t.getTimePassed();
+  // tracking mode (full image search every fullScanInterval frames)
+  UArUcoDetector tracker(cv::aruco::DICT_4X4_50);
+  tracker.tracking = true;
+  int found4 = 0;
+  t.now();
+  for (int i = 0; i < LOOP_CNT; i++)
+    found4 += tracker.detect(grays[i % grays.size()], ids, corners);
+  float dt4 = t.getTimePassed();
+  printf("# average ArUco analysis took %.2f ms (new detector each frame, %d markers)\n", dt1 / LOOP_CNT * 1000, found);
+  printf("# average ArUco analysis took %.2f ms (UArUcoDetector, BGR frame, %d markers)\n", dt2 / LOOP_CNT * 1000, found2);
+  printf("# average ArUco analysis took %.2f ms (UArUcoDetector, gray frame, %d markers)\n", dt3 / LOOP_CNT * 1000, found3);
+  printf("# average ArUco analysis took %.2f ms (UArUcoDetector, gray frame, tracking, %d markers)\n", dt4 / LOOP_CNT * 1000, found4);
+  tracker.printStatus();
+  // large markers in a downscaled image (corners refined in full resolution),
+  // small markers in full resolution, the marker count should match the full resolution only
+  for (int scale = 2; scale <= 4; scale *= 2)
+  {
+    UArUcoDetector pyr(cv::aruco::DICT_4X4_50);
+    pyr.coarseScale = scale;
+    int found5 = 0;
+    t.now();
+    for (int i = 0; i < LOOP_CNT; i++)
+      found5 += pyr.detect(grays[i % grays.size()], ids, corners);
+    float dt5 = t.getTimePassed();
+    printf("# average ArUco analysis took %.2f ms (UArUcoDetector, gray frame, coarse scale 1/%d, %d markers)\n",
+           dt5 / LOOP_CNT * 1000, scale, found5);
+    pyr.printStatus();
+  }
+  return 0;
+}
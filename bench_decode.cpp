@@ -0,0 +1,164 @@
+/***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+/**
+ * Micro-benchmark for message dispatch in UBridge::decode.
+ * Replays the received messages from a bridge log (log_rx_tx_*.txt)
+ * and compares the old strncmp chain with the UDecodeTable lookup.
+ *
+ * Usage: ./bench_decode [log_rx_tx_xxx.txt [repeats]]
+ * without a logfile a typical message mix is used. */
+
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+#include <string>
+#include "ubridge.h"
+
+/** number of calls to each handler (so nothing is optimized away) */
+static int handled[20];
+
+/**
+ * The dispatch as it was before the decode table.
+ * \returns handler index */
+static int decodeChain(const char * message)
+{
+  if (strncmp(message, "hbt ", 4) == 0)
+    return 0;
+  else if (strncmp(message, "pse ", 4) == 0)
+    return 1;
+  else if (strncmp(message, "lip ", 4) == 0)
+    return 2;
+  else if (strncmp(message, "event", 5)==0)
+    return 3;
+  else if (strncmp(message, "mis ", 4)==0)
+    return 4;
+  else if (strncmp(message, "rid ", 4)==0)
+    return 5;
+  else if (strncmp(message, "joy ", 4)==0)
+    return 6;
+  else if (strncmp(message, "wve ", 4)==0)
+    return 7;
+  else if (strncmp(message, "mca ", 4)==0)
+    return 8;
+  else if (strncmp(message, "irc ", 4)==0)
+    return 9;
+  else if (strncmp(message, "acw ", 4)==0)
+    return 10;
+  else if (strncmp(message, "gyw ", 4)==0)
+    return 11;
+  else if (strncmp(message, "bridge", 6)==0)
+    return 12;
+  else if (*message == '#')
+    return 13;
+  return 14;
+}
+
+static void count(UData * item, char * msg)
+{
+  handled[(long)item]++;
+}
+
+/**
+ * Get received messages from a bridge logfile,
+ * lines look like "1576..  0.5%, 12.345<-: pse 0.1 0.2 0.3" */
+static void readLog(const char * name, std::vector<std::string> & msgs)
+{
+  FILE * f = fopen(name, "r");
+  if (f == NULL)
+  {
+    perror(name);
+    return;
+  }
+  const int MSL = 600;
+  char s[MSL];
+  while (fgets(s, MSL, f) != NULL)
+  {
+    char * p1 = strstr(s, "<-: ");
+    if (p1 != NULL)
+    {
+      p1 += 4;
+      char * p2 = strchr(p1, '\n');
+      if (p2 != NULL)
+        *p2 = '\0';
+      msgs.push_back(p1);
+    }
+  }
+  fclose(f);
+}
+
+static double nowNs()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main(int argc, char ** argv)
+{
+  std::vector<std::string> msgs;
+  int repeats = 2000;
+  if (argc > 1)
+    readLog(argv[1], msgs);
+  if (argc > 2)
+    repeats = strtol(argv[2], NULL, 10);
+  if (msgs.empty())
+  { // typical mix at the default subscription rates
+    const char * mix[] = {"pse 1.234 0.567 0.789", "gyw 0.1 -0.2 0.3", "acw 0.01 0.02 9.81",
+                          "irc 0.312 0.845 2001 1500", "wve 0.300 0.301", "mca 0.5 0.6",
+                          "gyw 0.1 -0.2 0.3", "acw 0.01 0.02 9.81", "lip 0 0 0 0 0 0 0 0 0",
+                          "hbt 123.4 12.1 1 2 0 300", "event 30", "mis 0 2 3 'mission' 0 100"};
+    for (int i = 0; i < 100; i++)
+      for (unsigned j = 0; j < sizeof(mix)/sizeof(mix[0]); j++)
+        msgs.push_back(mix[j]);
+    printf("# no logfile - using %d messages of a typical mix\n", (int)msgs.size());
+  }
+  else
+    printf("# replaying %d received messages from %s\n", (int)msgs.size(), argv[1]);
+  // same tags as registered by the UData items in UBridge
+  UDecodeTable table;
+  const char * tags[] = {"hbt", "pse", "lip", "event", "mis", "rid", "joy",
+                         "wve", "mca", "irc", "acw", "gyw", "bridge"};
+  for (int i = 0; i < 13; i++)
+    table.add(tags[i], (UData*)(long)i, count);
+  // before - strncmp chain
+  double t0 = nowNs();
+  for (int r = 0; r < repeats; r++)
+    for (const std::string & m : msgs)
+      handled[decodeChain(m.c_str())]++;
+  double t1 = nowNs();
+  // after - decode table
+  for (int r = 0; r < repeats; r++)
+    for (std::string & m : msgs)
+    {
+      const UDecodeTable::Entry * e = table.find(m.c_str());
+      if (e != NULL)
+        e->func(e->item, &m[0]);
+      else
+        handled[14]++;
+    }
+  double t2 = nowNs();
+  double n = double(msgs.size()) * repeats;
+  printf("# strncmp chain: %6.2f ns/message\n", (t1 - t0) / n);
+  printf("# decode table : %6.2f ns/message\n", (t2 - t1) / n);
+  printf("# (%d handler calls)\n", handled[1] + handled[11]);
+  return 0;
+}
@@ -0,0 +1,140 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+/**
+ * Benchmark for the 10-bit to 8-bit Bayer unpack in UV4l2::process_image.
+ * Uses a stored raw frame (e.g. frame-1.raw saved by process_image) or
+ * a generated frame, and reports the unpack time per frame with and without SIMD.
+ *
+ * Usage: ./bench_unpack [frame.raw [width height [repeats]]]
+ * a frame of width*height*2 bytes is taken as SBGGR10, width*height*5/4 bytes as SBGGR10P.
+ * Also times the half resolution (no demosaicing) conversions. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+#include "ubayer.h"
+
+static double nowUs()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e6 + t.tv_nsec * 1e-3;
+}
+
+/**
+ * time one unpack function
+ * \returns time per frame in us */
+template <class F>
+static double timeIt(F f, int repeats)
+{
+  f(); // warm up cache and page tables
+  double t0 = nowUs();
+  for (int r = 0; r < repeats; r++)
+    f();
+  return (nowUs() - t0) / repeats;
+}
+
+int main(int argc, char ** argv)
+{
+  int w = 1920;
+  int h = 1080;
+  int repeats = 100;
+  if (argc > 3)
+  {
+    w = strtol(argv[2], NULL, 10);
+    h = strtol(argv[3], NULL, 10);
+  }
+  if (argc > 4)
+    repeats = strtol(argv[4], NULL, 10);
+  const int n = w * h;
+  std::vector<uint16_t> raw10(n);
+  std::vector<uint8_t> raw10p(n / 4 * 5);
+  bool useFile = argc > 1;
+  bool packedOnly = false;
+  if (useFile)
+  {
+    FILE * f = fopen(argv[1], "rb");
+    if (f == NULL)
+    {
+      perror(argv[1]);
+      return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    size_t got = 0;
+    if (size >= long(n) * 2)
+      got = fread(raw10.data(), 2, n, f) * 2;
+    else if (size >= long(raw10p.size()))
+    {
+      got = fread(raw10p.data(), 1, raw10p.size(), f);
+      packedOnly = true;
+    }
+    fclose(f);
+    if (got == 0)
+    {
+      printf("# %s is too small for %dx%d pixels (%ld bytes)\n", argv[1], w, h, size);
+      return 1;
+    }
+    printf("# using %s as %s %dx%d\n", argv[1], packedOnly ? "SBGGR10P" : "SBGGR10", w, h);
+  }
+  else
+  { // generated 10-bit frame
+    for (int i = 0; i < n; i++)
+      raw10[i] = (i * 7 + i / w * 13) & 0x3ff;
+    printf("# using a generated %dx%d frame\n", w, h);
+  }
+  if (not packedOnly)
+  { // make the packed version of the same frame
+    for (int i = 0; i < n; i += 4)
+    {
+      uint8_t * g = &raw10p[i / 4 * 5];
+      g[4] = 0;
+      for (int j = 0; j < 4; j++)
+      {
+        g[j] = raw10[i + j] >> 2;
+        g[4] |= (raw10[i + j] & 3) << (j * 2);
+      }
+    }
+  }
+  std::vector<uint8_t> a(n), b(n);
+  if (not packedOnly)
+  {
+    double ts = timeIt([&]{ bayer10to8scalar(raw10.data(), a.data(), n); }, repeats);
+    double tv = timeIt([&]{ bayer10to8(raw10.data(), b.data(), n); }, repeats);
+    printf("# SBGGR10  scalar %8.1f us/frame, SIMD %8.1f us/frame, same result=%d\n",
+           ts, tv, memcmp(a.data(), b.data(), n) == 0);
+  }
+  memset(b.data(), 0, n);
+  double ts = timeIt([&]{ bayer10Pto8scalar(raw10p.data(), a.data(), n); }, repeats);
+  double tv = timeIt([&]{ bayer10Pto8(raw10p.data(), b.data(), n); }, repeats);
+  printf("# SBGGR10P scalar %8.1f us/frame, SIMD %8.1f us/frame, same result=%d\n",
+         ts, tv, memcmp(a.data(), b.data(), n) == 0);
+  // half resolution capture modes from the 8-bit Bayer image
+  std::vector<uint8_t> half(n / 4 * 3);
+  double thc = timeIt([&]{ bayer8HalfBGR(a.data(), w, half.data(), w / 2 * 3, w / 2, h / 2); }, repeats);
+  double thg = timeIt([&]{ bayer8HalfGray(a.data(), w, half.data(), w / 2, w / 2, h / 2); }, repeats);
+  printf("# half resolution BGR %8.1f us/frame, gray %8.1f us/frame\n", thc, thg);
+  return 0;
+}
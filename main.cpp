@@ -34,11 +34,14 @@ using namespace std;
 
 void printHelp(char * name)
 { // show help
-  printf("\nUsage: %s [<from mission> [<to mission>]] [n IP] [h]\n\n", name);
+  printf("\nUsage: %s [<from mission> [<to mission>]] [n IP] [m=file] [t] [h]\n\n", name);
   printf("<from mission part> and <to mission part>:\n");
   printf("         number in the range 1..998, and the code\n");
   printf("         run only the mission parts in this range.\n");
   printf(" n=IP    IP is direct IP or URL (default is 127.0.0.1)\n");
+  printf(" m=file  Load missions from file (see Navigation/missions), these replace\n");
+  printf("         built-in missions with the same number\n");
+  printf(" t       Record binary telemetry (log_telemetry_*.bin, see telemetry2txt)\n");
   printf(" h       This help text\n\n");
   printf("E.g.: './%s 2 2' runs mission part 2 only\n\n", name);
   printf("NB!  Robot may continue to move if this app is stopped with ctrl-C.\n");
@@ -48,7 +51,9 @@ void printHelp(char * name)
 bool readCommandLineParameters(int argc, char ** argv, 
                                int * firstMission, 
                                int * lastMission, 
-                               const char ** bridgeIp)
+                               const char ** bridgeIp,
+                               const char ** missionFile,
+                               bool * recordTelemetry)
 {
   // are there mission parameters
   bool startNumber = true;
@@ -72,6 +77,17 @@ bool readCommandLineParameters(int argc, char ** argv,
           (*bridgeIp)++;
         printf("n-parameter '%s'\n", *bridgeIp);
         break;
+      case 'm':
+        if (i > 0)
+        { // mission file (argv[0] may be 'mission')
+          *missionFile = &argv[i][1];
+          while (((*missionFile)[0] <= ' ' and (*missionFile)[0] > '\0') or (*missionFile)[0] == '=')
+            (*missionFile)++;
+        }
+        break;
+      case 't':
+        *recordTelemetry = true;
+        break;
       default:
         if (isdigit(argv[i][0]))
         {
@@ -185,14 +201,18 @@ int main ( int argc,char **argv )
   int firstMissionPart = 1;
   int lastMissionPart = 998;
   const char * bridgeIp = "127.0.0.1"; // default connection IP to bridge
+  bool recordTelemetry = false;
+  const char * missionFile = NULL;
   const int MSL = 250;
   char s[MSL];
   //
-  bool isOK = readCommandLineParameters(argc, argv, &firstMissionPart, &lastMissionPart, &bridgeIp);
+  bool isOK = readCommandLineParameters(argc, argv, &firstMissionPart, &lastMissionPart, &bridgeIp, &missionFile, &recordTelemetry);
   if (isOK)
   { // create connection to Regbot board through bridge 
     // (IP number (127.0.0.1 is localhost, 2. param is logOpen)
     UBridge bridge(bridgeIp, false);
+    if (recordTelemetry)
+      telemetry.open();
     // create camera interface
     
 
@@ -201,6 +221,8 @@ int main ( int argc,char **argv )
     // set mission range (default is 1..988 (all))
     mission.fromMission = firstMissionPart;
     mission.toMission = lastMissionPart;
+    if (missionFile != NULL)
+      mission.loadPlan(missionFile);
     // start mission thread
     mission.start();
     //
@@ -305,6 +327,14 @@ int main ( int argc,char **argv )
                   mission.closeLog();
                 n++;
               }
+              if (strstr(s, "telemetry") != NULL)
+              {
+                if (s[1] == 'o')
+                  telemetry.open();
+                else
+                  telemetry.close();
+                n++;
+              }
               if (n == 0)
                 printf("# logfile not found in '%s' (see help)\n", s);
             }
@@ -371,7 +401,8 @@ int main ( int argc,char **argv )
             printf("#    e V   Set camera exposure to V (1..10000?) (4-1180?)\n");
             printf("#    h    This help\n");
             printf("#    lo xxx  Open log for xxx (pose %d, hbt %d, bridge %d, imu %d\n"
-                   "#               ir %d, motor %d, joy %d, event %d, cam %d, aruco d, mission d)\n",
+                   "#               ir %d, motor %d, joy %d, event %d, cam %d, aruco d, mission d,\n"
+                   "#               telemetry %d (binary, all data))\n",
                    bridge.pose->logIsOpen(), 
                    bridge.info->logIsOpen(),
                    bridge.logIsOpen(), 
@@ -382,7 +413,8 @@ int main ( int argc,char **argv )
                    bridge.event->logIsOpen(),
                 //   cam.logCamIsOpen(),
               //     cam.arUcos->logArucoIsOpen(),
-                   mission.logIsOpen()
+                   mission.logIsOpen(),
+                   telemetry.isOpen()
                   );
             printf("#    lc xxx  Close log for xxx\n");
             printf("#    o    Loop-test for steady ArUco marker (makes logfile)\n");
@@ -82,6 +82,41 @@ int tcpCase::readChar(char * buf, bool * error)
   return numbytes;
 }
 
+int tcpCase::readBlock(char * buf, int bufSize, int timeoutMs, bool * error)
+{ // wait for data, then get all available (up to bufSize) into buffer
+  int numbytes = 0;
+  *error = false;
+  pollfd pfd;
+  pfd.fd = soc;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  int n = poll(&pfd, 1, timeoutMs);
+  if (n < 0)
+  {
+    if (errno != EINTR)
+    {
+      *error = true;
+      numbytes = -1;
+    }
+  }
+  else if (n > 0)
+  { // something happened on the socket
+    numbytes = recv(soc, buf, bufSize, MSG_DONTWAIT);
+    if (numbytes == -1)
+    {
+      if (errno != EAGAIN and errno != EWOULDBLOCK)
+        *error = true;
+      else
+        numbytes = 0;
+    }
+    else if (numbytes == 0)
+    { // readable, but no data - connection closed from other end
+      *error = true;
+    }
+  }
+  return numbytes;
+}
+
 
 int tcpCase::sendData(const char *msg)
 {//Send some data
@@ -21,6 +21,7 @@
 #include <arpa/inet.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <poll.h>
 #include <time.h>
 
 
@@ -47,6 +48,15 @@ protected:
    * Receive 1 character from socket 
    * \returns the character or 0 if no data */
   int readChar(char * buf, bool * socError);
+  /**
+   * Wait (in poll) for data on the socket and receive
+   * what is available in the kernel buffer - up to bufSize bytes.
+   * \param buf is the destination buffer
+   * \param bufSize is the space available in buf
+   * \param timeoutMs is the maximum wait time in ms
+   * \param socError is set true if socket has an error or is closed
+   * \returns number of bytes received, 0 on timeout or -1 on error */
+  int readBlock(char * buf, int bufSize, int timeoutMs, bool * socError);
   
 public:
   bool connected;
@@ -0,0 +1,266 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+/**
+ * Convert a binary telemetry recording (log_telemetry_<date>.bin)
+ * to the text logfiles made by the mission app,
+ * i.e. log_odometry_<date>.txt, log_accgyro_<date>.txt, log_motor_<date>.txt,
+ * log_irdist_<date>.txt, log_edge_<date>.txt, log_event_<date>.txt and log_ArUco_<date>.txt
+ * (only for the data types found in the recording).
+ *
+ * Usage: ./telemetry2txt log_telemetry_xxx.bin */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "urecorder.h"
+
+/** name of text logfile and header lines for each record type */
+static const struct
+{
+  const char * prename;
+  const char * header;
+} textLog[URecorder::REC_TYPE_CNT] = {
+  {NULL, NULL},
+  {"log_odometry", "% robobot mission pose logfile\n"
+                   "% 1 Timestamp in seconds\n"
+                   "% 2 x (forward)\n"
+                   "% 3 y (left)\n"
+                   "% 4 h (heading in radians)\n"},
+  {"log_accgyro", "% robobot mission Accelerometer and gyro log\n"
+                  "% 1 Timestamp in seconds\n"
+                  "% 2-4 accelerometer x,y,z [m/s^2]\n"
+                  "% 5-7 gyro x,y,z [deg/s]\n"},
+  {"log_motor", "% robobot mission Accelerometer and gyro log\n"
+                "% 1 Timestamp in seconds\n"
+                "% 2,3 Velocity (m/s) left and right,\n"
+                "% 4,5 Motor current (Amps) left and right,\n"},
+  {"log_irdist", "% robobot mission IR distance log\n"
+                 "% 1 Timestamp in seconds\n"
+                 "% 2 IR 1 distance [meter]\n"
+                 "% 3 IR 2 distance [meter]\n"
+                 "% 4 IR 1 raw [AD value]\n"
+                 "% 5 IR 2 raw [AD value]\n"},
+  {"log_edge", "% robobot mission edge sensor log\n"
+               "% 1 Timestamp in seconds\n"
+               "% 2 edge left valid\n"
+               "% 3 edge right valid\n"
+               "% 4 crossing black line\n"
+               "% 5 crossing white line\n"},
+  {"log_event", "% robobot IR distance log\n"
+                "% 1 Timestamp in seconds\n"
+                "% 2 event set (-1=not set)\n"
+                "% 3 event cleared (-1=not cleared)\n"},
+  {"log_ArUco", "% Mission ArUco log (converted from telemetry)\n"
+                "% 1   Time [sec]\n"
+                "% 3   image number\n"
+                "% 4   ArUco ID\n"
+                "% 5-7 Position (x,y,z) [m] (robot coordinates)\n"
+                "% 8   Distance to marker [m]\n"
+                "% 9   Marker angle [radians] - assumed vertical marker.\n"
+                "% 10  Marker is vertical (on a wall)\n"
+                "% 11  Processing time [sec].\n"}
+};
+
+static FILE * logs[URecorder::REC_TYPE_CNT];
+
+/**
+ * Get (or create) text logfile for this type */
+static FILE * getLog(int type, const char * date)
+{
+  if (logs[type] == NULL)
+  {
+    const int MNL = 256;
+    char name[MNL];
+    snprintf(name, MNL, "%s_%s.txt", textLog[type].prename, date);
+    logs[type] = fopen(name, "w");
+    if (logs[type] == NULL)
+      perror(name);
+    else
+    {
+      fputs(textLog[type].header, logs[type]);
+      printf("# writing %s\n", name);
+    }
+  }
+  return logs[type];
+}
+
+/**
+ * Write one record in the text format of the mission app */
+static void writeRecord(FILE * f, const URecorder::RecHeader * h, const char * d)
+{
+  long ms = h->usec / 1000;
+  long sec = h->sec;
+  switch (h->type)
+  {
+    case URecorder::REC_POSE:
+    {
+      const URecorder::RecPose * r = (const URecorder::RecPose *)d;
+      fprintf(f, "%ld.%03ld %.3f %.3f %.4f\n", sec, ms, r->x, r->y, r->h);
+      break;
+    }
+    case URecorder::REC_IMU:
+    {
+      const URecorder::RecImu * r = (const URecorder::RecImu *)d;
+      fprintf(f, "%ld.%03ld %.3f %.3f %.3f %.3f %.3f %.3f\n", sec, ms, 
+              r->acc[0], r->acc[1], r->acc[2], r->gyro[0], r->gyro[1], r->gyro[2]);
+      break;
+    }
+    case URecorder::REC_MOTOR:
+    {
+      const URecorder::RecMotor * r = (const URecorder::RecMotor *)d;
+      fprintf(f, "%ld.%03ld %.3f %.3f %.3f %.3f\n", sec, ms, 
+              r->velocity[0], r->velocity[1], r->current[0], r->current[1]);
+      break;
+    }
+    case URecorder::REC_IR:
+    {
+      const URecorder::RecIr * r = (const URecorder::RecIr *)d;
+      fprintf(f, "%ld.%03ld %.3f %.3f %d %d\n", sec, ms, r->dist[0], r->dist[1], r->raw[0], r->raw[1]);
+      break;
+    }
+    case URecorder::REC_EDGE:
+    {
+      const URecorder::RecEdge * r = (const URecorder::RecEdge *)d;
+      fprintf(f, "%ld.%03ld %d %d %d %d\n", sec, ms, 
+              r->validLeft, r->validRight, r->crossingBlack, r->crossingWhite);
+      break;
+    }
+    case URecorder::REC_EVENT:
+    {
+      const URecorder::RecEvent * r = (const URecorder::RecEvent *)d;
+      if (r->set >= 0)
+        fprintf(f, "%ld.%03ld %2d -1\n", sec, ms, r->set);
+      else
+      { // same text as when event flag is cleared
+        switch (r->cleared)
+        {
+          case  0: fprintf(f, "%ld.%03ld -1 %2d (stop)\n", sec, ms, r->cleared); break;
+          case 33: fprintf(f, "%ld.%03ld -1 %2d (start)\n", sec, ms, r->cleared); break;
+          case 30: fprintf(f, "%ld.%03ld -1 %2d (next snippet)\n", sec, ms, r->cleared); break;
+          case 31: fprintf(f, "%ld.%03ld -1 %2d (next snippet)\n", sec, ms, r->cleared); break;
+          default: fprintf(f, "%ld.%03ld -1 %2d\n", sec, ms, r->cleared); break;
+        }
+      }
+      break;
+    }
+    case URecorder::REC_ARUCO:
+    {
+      const URecorder::RecAruco * r = (const URecorder::RecAruco *)d;
+      fprintf(f, "%ld.%03ld %d %d %.3f %.3f %.3f  %.3f %.4f %d %.3f\n", sec, ms, 
+              r->frame, r->id, r->x, r->y, r->z, r->distance, r->angle, r->vertical, r->procTime);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc < 2)
+  {
+    printf("Usage: %s log_telemetry_xxx.bin\n", argv[0]);
+    printf("Converts a binary telemetry recording to the text logfile formats\n");
+    return 1;
+  }
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd < 0 or fstat(fd, &st) != 0)
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  size_t size = st.st_size;
+  if (size < sizeof(URecorder::FileHeader))
+  {
+    printf("# %s is too short for a telemetry file\n", argv[1]);
+    return 1;
+  }
+  const char * data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  // check schema against this version
+  const URecorder::FileHeader * fh = (const URecorder::FileHeader *)data;
+  URecorder::FileHeader expected;
+  URecorder::makeHeader(&expected);
+  if (strncmp(fh->magic, expected.magic, 8) != 0 or fh->version != URecorder::VERSION)
+  {
+    printf("# %s is not a telemetry file (version %d)\n", argv[1], URecorder::VERSION);
+    return 1;
+  }
+  bool typeOK[URecorder::REC_TYPE_CNT];
+  for (int i = 0; i < URecorder::REC_TYPE_CNT; i++)
+  {
+    typeOK[i] = i < (int)fh->typeCnt and fh->schema[i].size == expected.schema[i].size;
+    if (not typeOK[i])
+      printf("# record type %d (%s) has another layout - ignored\n", i, expected.schema[i].name);
+  }
+  // date part of filename is used for the text logs
+  const char * base = strrchr(argv[1], '/');
+  base = (base == NULL) ? argv[1] : base + 1;
+  const int MDL = 64;
+  char date[MDL];
+  const char * p1 = strstr(base, "log_telemetry_");
+  snprintf(date, MDL, "%s", (p1 == NULL) ? base : p1 + strlen("log_telemetry_"));
+  char * p2 = strstr(date, ".bin");
+  if (p2 != NULL)
+    *p2 = '\0';
+  //
+  size_t pos = sizeof(URecorder::FileHeader);
+  int cnt = 0;
+  int unknownCnt = 0;
+  while (pos + sizeof(URecorder::RecHeader) <= size)
+  {
+    const URecorder::RecHeader * h = (const URecorder::RecHeader *)&data[pos];
+    if (h->type == URecorder::REC_SKIP)
+    { // rest of segment is unused
+      pos = (pos / URecorder::SEGMENT_SIZE + 1) * URecorder::SEGMENT_SIZE;
+      continue;
+    }
+    size_t next = pos + sizeof(URecorder::RecHeader) + URecorder::recordSpace(h->size);
+    if (next > size)
+      break;
+    if (h->type < URecorder::REC_TYPE_CNT and typeOK[h->type])
+    {
+      FILE * f = getLog(h->type, date);
+      if (f != NULL)
+        writeRecord(f, h, &data[pos + sizeof(URecorder::RecHeader)]);
+      cnt++;
+    }
+    else
+      unknownCnt++;
+    pos = next;
+  }
+  for (int i = 0; i < URecorder::REC_TYPE_CNT; i++)
+    if (logs[i] != NULL)
+      fclose(logs[i]);
+  printf("# converted %d records (%d unknown)\n", cnt, unknownCnt);
+  munmap((void *)data, size);
+  close(fd);
+  return 0;
+}
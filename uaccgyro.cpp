@@ -24,6 +24,8 @@
 UAccGyro::UAccGyro(UBridge* bridge_ptr, bool openlog)
 {
   bridge = bridge_ptr;
+  bridge->registerMessage("acw", this, [](UData * item, char * msg) { ((UAccGyro*)item)->decode(msg); });
+  bridge->registerMessage("gyw", this, [](UData * item, char * msg) { ((UAccGyro*)item)->decode(msg); });
   if (openlog)
     openLog();
 }
@@ -62,9 +64,14 @@ void UAccGyro::decode(char* msg)
   if (isOK)
   {
     updated();
+    Snapshot ds = {dataTime, {acc[0], acc[1], acc[2]}, {gyro[0], gyro[1], gyro[2]}};
+    snap.write(ds);
+    if (telemetry.isOpen())
+      telemetry.add(URecorder::REC_IMU, dataTime, 
+                    URecorder::RecImu{{acc[0], acc[1], acc[2]}, {gyro[0], gyro[1], gyro[2]}});
     if (logfile != NULL)
     {
-      fprintf(logfile, "%ld.%03ld %.3f %.3f %.3f %.3f %.3f %.3f\n", dataTime.tv_sec, dataTime.tv_usec / 1000, acc[0], acc[1], acc[2], gyro[0], gyro[1], gyro[2]);
+      logWriter.print(logfile, "%ld.%03ld %.3f %.3f %.3f %.3f %.3f %.3f\n", dataTime.tv_sec, dataTime.tv_usec / 1000, acc[0], acc[1], acc[2], gyro[0], gyro[1], gyro[2]);
     }
   }
 }
@@ -153,6 +153,7 @@ void ArUcoVals::printStatus()
       cnt++;
   }
   printf("# Detected %d codes, %d attempts\n", cnt, frameCnt);
+  detector.printStatus();
   for (int i = 0; i < MAX_VAL_CNT; i++)
   {
     v = &arucos[i];
@@ -269,17 +270,10 @@ void ArUcoVals::closeArucoLog()
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-int ArUcoVals::doArUcoProcessing(cv::Mat frame, int frameNumber, UTime imTime)
+int ArUcoVals::doArUcoProcessing(cv::Mat frame, int frameNumber, UTime imTime, UPose * imPose)
 {
   cv::Mat frameAnn;
   const float arucoSqaureDimensions = 0.100;      //meters
-  vector<int> markerIds;
-  vector<vector<cv::Point2f>> markerCorners; //, rejectedcandidates;
-  cv::aruco::DetectorParameters parameters;
-  //seach DICT on docs.opencv.org
-  cv::Ptr < cv::aruco::Dictionary> markerDictionary = cv::aruco::getPredefinedDictionary(cv::aruco::PREDEFINED_DICTIONARY_NAME::DICT_4X4_50); 
-  // marker position info
-  vector<cv::Vec3d> rotationVectors, translationVectors;
   UTime t; // timing calculation (for log)
   t.now(); // start timing
   // clear all flags (but maintain old information)
@@ -287,7 +281,29 @@ int ArUcoVals::doArUcoProcessing(cv::Mat frame, int frameNumber, UTime imTime)
   /** Each marker has 4 marker corners into 'markerCorners' in image pixel coordinates (float x,y).
    *  Marker ID is the detected marker ID, a vector of integer.
    * */
-  cv::aruco::detectMarkers(frame, markerDictionary, markerCorners, markerIds);
+  if (detector.tracking)
+  { // predict marker position in image from robot motion since last frame
+    if (imTime - lastImTime > 0.5)
+      // too long ago to track
+      detector.resetTracks();
+    else if (imPose != NULL and lastPoseValid)
+    {
+      float dh = limitToPi(imPose->h - lastPose.h);
+      // driven distance in heading direction
+      float ds = (imPose->x - lastPose.x) * cos(lastPose.h) + (imPose->y - lastPose.y) * sin(lastPose.h);
+      float scale = 1;
+      if (nearestMarker > ds + 0.05)
+        scale = nearestMarker / (nearestMarker - ds);
+      // turning left moves markers to the right in image
+      detector.predict(cam->cameraMatrix.at<double>(0,0) * dh, scale,
+                       cv::Point2f(cam->cameraMatrix.at<double>(0,2), cam->cameraMatrix.at<double>(1,2)));
+    }
+  }
+  lastImTime = imTime;
+  lastPoseValid = imPose != NULL;
+  if (lastPoseValid)
+    lastPose = *imPose;
+  detector.detect(frame, markerIds, markerCorners);
   // marker size is same as detected markers
   // printf("# Found %ld marker corners\n", markerCorners.size());
   if (markerIds.size() > 0)
@@ -304,6 +320,10 @@ int ArUcoVals::doArUcoProcessing(cv::Mat frame, int frameNumber, UTime imTime)
                                          cam->distortionCoefficients, 
                                          rotationVectors, 
                                          translationVectors);
+    nearestMarker = translationVectors[0][2];
+    for (const cv::Vec3d & tv : translationVectors)
+      if (tv[2] < nearestMarker)
+        nearestMarker = tv[2];
   }
   else
     printf("# No markers found\n");
@@ -335,6 +355,13 @@ int ArUcoVals::doArUcoProcessing(cv::Mat frame, int frameNumber, UTime imTime)
       //       v->done = true;
 //       printf("# debug images = %d, logArUco = %d\n", debugImages, logArUco != NULL);
       // maybe also log of data
+      if (telemetry.isOpen())
+      {
+        URecorder::RecAruco r = {v->frameNumber, v->markerId,
+                                 v->markerPosition.at<float>(0,0), v->markerPosition.at<float>(0,1), v->markerPosition.at<float>(0,2),
+                                 v->distance2marker, v->markerAngle, v->markerVertical, t.getTimePassed()};
+        telemetry.add(URecorder::REC_ARUCO, imTime.getTimeval(), r);
+      }
       if (logArUco != NULL)
       {
         /*
@@ -34,6 +34,7 @@
 #include "ubridge.h"
 #include "utime.h"
 #include "ulibpose.h"
+#include "uarucodetector.h"
 // #include "u2dline.h"
 // this should be defined in the CMakeList.txt ? or ?
 #ifdef raspicam_CV_LIBS
@@ -147,13 +148,19 @@ public:
   /**
    * Number of frames analized */
   int frameCnt = 0;
+  /**
+   * Marker detector (dictionary, parameters and buffers kept between frames) */
+  UArUcoDetector detector;
   
 public:
   /** constructor 
    * \param iCam is pointer to source calera. */
   ArUcoVals(UCamera * iCam)
+    : detector(cv::aruco::DICT_4X4_50)
   {
     cam = iCam;
+    // search near known markers, when frames are close in time
+    detector.tracking = true;
   }
   /** Destructor */
   ~ArUcoVals()
@@ -196,9 +203,11 @@ public:
    * \param frame is the image (in RGB format) to investigate
    * \param framenumber is the image number for the frame
    * \param imTime is time for frame capture
+   * \param imPose is robot pose at image time (if known), used to predict
+   *        marker positions when tracking (detector.tracking)
    * \returns number of codes found.
    * */
-  int doArUcoProcessing(cv::Mat frame, int frameNumber, UTime imTime);
+  int doArUcoProcessing(cv::Mat frame, int frameNumber, UTime imTime, UPose * imPose = NULL);
   /**
    * conver position and rotation of camera to 
    * coordinate conversion matrix 
@@ -232,6 +241,16 @@ public:
 private:
   /// logfile for ArUco extract
   FILE * logArUco = NULL;
+  /// detected markers and marker position info (kept to reuse allocated memory)
+  vector<int> markerIds;
+  vector<vector<cv::Point2f> > markerCorners;
+  vector<cv::Vec3d> rotationVectors, translationVectors;
+  /// image time and robot pose at last frame (for marker tracking)
+  UTime lastImTime;
+  UPose lastPose;
+  bool lastPoseValid = false;
+  /// distance to nearest marker in last frame [m]
+  float nearestMarker = 10;
   
 };
 
@@ -0,0 +1,230 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <math.h>
+#include <stdio.h>
+#include <opencv2/imgproc.hpp>
+#include "uarucodetector.h"
+#include "urun.h"
+#include "utime.h"
+
+
+UArUcoDetector::UArUcoDetector(int dictionaryName)
+{
+  dictionary = cv::aruco::getPredefinedDictionary(dictionaryName);
+  parameters = cv::aruco::DetectorParameters::create();
+  coarseParameters = cv::aruco::DetectorParameters::create();
+  fineParameters = cv::aruco::DetectorParameters::create();
+}
+
+int UArUcoDetector::detect(const cv::Mat & frame,
+                           std::vector<int> & ids,
+                           std::vector<std::vector<cv::Point2f> > & corners)
+{
+  const cv::Mat * im = &frame;
+  if (frame.channels() == 3)
+  { // detector works on gray, cvtColor reuses the buffer for same size
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    im = &gray;
+  }
+  bool full = not tracking or tracks.empty() or framesSinceFullScan >= fullScanInterval;
+  if (not full)
+  {
+    full = not detectTracked(*im, ids, corners);
+    if (full)
+      lostCnt++;
+    else
+    {
+      trackedCnt++;
+      framesSinceFullScan++;
+    }
+  }
+  if (full)
+  {
+    detectFull(*im, ids, corners);
+    fullScanCnt++;
+    framesSinceFullScan = 1;
+  }
+  // prediction is for one frame only
+  predShift = 0;
+  predScale = 1;
+  // markers to track in next frame
+  tracks.clear();
+  if (tracking)
+  {
+    for (unsigned int i = 0; i < ids.size(); i++)
+    {
+      const std::vector<cv::Point2f> & c = corners[i];
+      float x1 = c[0].x, x2 = c[0].x, y1 = c[0].y, y2 = c[0].y;
+      for (unsigned int k = 1; k < c.size(); k++)
+      {
+        x1 = fminf(x1, c[k].x);
+        x2 = fmaxf(x2, c[k].x);
+        y1 = fminf(y1, c[k].y);
+        y2 = fmaxf(y2, c[k].y);
+      }
+      Track t;
+      t.id = ids[i];
+      t.box = cv::Rect2f(x1, y1, x2 - x1, y2 - y1);
+      tracks.push_back(t);
+    }
+  }
+  return ids.size();
+}
+
+void UArUcoDetector::detectFull(const cv::Mat & im,
+                                std::vector<int> & ids,
+                                std::vector<std::vector<cv::Point2f> > & corners)
+{
+  ids.clear();
+  corners.clear();
+  if (coarseScale <= 1)
+  {
+    cv::aruco::detectMarkers(im, dictionary, corners, ids, parameters);
+    return;
+  }
+  UTime t;
+  t.now();
+  // large markers in the downscaled image
+  const int f = coarseScale;
+  cv::resize(im, coarse, cv::Size(im.cols / f, im.rows / f), 0, 0, cv::INTER_AREA);
+  coarseParameters->minMarkerPerimeterRate = coarsePerimeterRate;
+  cv::aruco::detectMarkers(coarse, dictionary, coarseCorners, coarseIds, coarseParameters);
+  float dt = t.getTimePassed() * 1000;
+  coarseMs = (coarseMs * 15 + dt) / 16;
+  // small markers in full resolution, a bit of overlap, so none are lost between the two
+  t.now();
+  *fineParameters = *parameters;
+  fineParameters->maxMarkerPerimeterRate = fmin(parameters->maxMarkerPerimeterRate, coarsePerimeterRate * 1.25);
+  cv::aruco::detectMarkers(im, dictionary, corners, ids, fineParameters);
+  dt = t.getTimePassed() * 1000;
+  fineMs = (fineMs * 15 + dt) / 16;
+  if (coarseIds.size() > 0)
+  { // corners of large markers in full resolution
+    t.now();
+    std::vector<cv::Point2f> all;
+    for (std::vector<cv::Point2f> & c : coarseCorners)
+      for (cv::Point2f & p : c)
+        all.push_back(cv::Point2f((p.x + 0.5) * f - 0.5, (p.y + 0.5) * f - 0.5));
+    // window must cover the position uncertainty from the downscaled image
+    cv::cornerSubPix(im, all, cv::Size(f + 2, f + 2), cv::Size(-1, -1),
+                     cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01));
+    int n = 0;
+    for (unsigned int k = 0; k < coarseIds.size(); k++)
+    {
+      std::vector<cv::Point2f> & c = coarseCorners[k];
+      cv::Point2f center(0, 0);
+      for (cv::Point2f & p : c)
+      {
+        p = all[n++];
+        center += p * 0.25;
+      }
+      // skip if found in full resolution too (in the overlap)
+      bool known = false;
+      float side = cv::norm(c[1] - c[0]);
+      for (unsigned int i = 0; i < ids.size() and not known; i++)
+      {
+        if (ids[i] == coarseIds[k])
+        {
+          cv::Point2f d = (corners[i][0] + corners[i][2]) * 0.5 - center;
+          known = cv::norm(d) < side / 2;
+        }
+      }
+      if (not known)
+      {
+        ids.push_back(coarseIds[k]);
+        corners.push_back(c);
+      }
+    }
+    dt = t.getTimePassed() * 1000;
+    refineMs = (refineMs * 15 + dt) / 16;
+  }
+}
+
+bool UArUcoDetector::detectTracked(const cv::Mat & im,
+                                   std::vector<int> & ids,
+                                   std::vector<std::vector<cv::Point2f> > & corners)
+{
+  ids.clear();
+  corners.clear();
+  const cv::Rect image(0, 0, im.cols, im.rows);
+  for (const Track & t : tracks)
+  {
+    bool found = false;
+    for (int id : ids)
+      // may be found in the search area of another marker
+      found |= id == t.id;
+    if (found)
+      continue;
+    // predicted position and size
+    cv::Point2f c(t.box.x + t.box.width / 2, t.box.y + t.box.height / 2);
+    c = predCenter + (c - predCenter) * predScale;
+    c.x += predShift;
+    float w = t.box.width * predScale;
+    float h = t.box.height * predScale;
+    float m = fmaxf(w, h) * roiMargin;
+    cv::Rect roi(int(c.x - w / 2 - m), int(c.y - h / 2 - m), int(w + 2 * m), int(h + 2 * m));
+    roi = roi & image;
+    if (roi.width < 8 or roi.height < 8)
+      // out of image
+      return false;
+    cv::aruco::detectMarkers(im(roi), dictionary, roiCorners, roiIds, parameters);
+    for (unsigned int k = 0; k < roiIds.size(); k++)
+    {
+      bool known = false;
+      for (int id : ids)
+        known |= id == roiIds[k];
+      if (known)
+        continue;
+      // corners in full image coordinates
+      for (cv::Point2f & p : roiCorners[k])
+      {
+        p.x += roi.x;
+        p.y += roi.y;
+      }
+      ids.push_back(roiIds[k]);
+      corners.push_back(roiCorners[k]);
+      found |= roiIds[k] == t.id;
+    }
+    if (not found)
+      // lost track
+      return false;
+  }
+  return true;
+}
+
+void UArUcoDetector::predict(float shiftX, float scale, cv::Point2f center)
+{
+  predShift = shiftX;
+  predScale = scale;
+  predCenter = center;
+}
+
+void UArUcoDetector::printStatus()
+{
+  printf("# ArUco detector tracking=%d (full scan every %d frames), %d full scans, %d tracked, %d lost tracks, tracking %d markers\n",
+         tracking, fullScanInterval, fullScanCnt, trackedCnt, lostCnt, (int)tracks.size());
+  if (coarseScale > 1)
+  {
+    printf("# ArUco detector coarse scale 1/%d (perimeter rate > %.2f), time per frame: coarse %.2f ms, full resolution %.2f ms, corner refinement %.2f ms\n",
+           coarseScale, coarsePerimeterRate, coarseMs, fineMs, refineMs);
+  }
+}
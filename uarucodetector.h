@@ -0,0 +1,147 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UARUCODETECTOR_H
+#define UARUCODETECTOR_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include <opencv2/aruco.hpp>
+
+/**
+ * Long lived ArUco marker detector.
+ * Dictionary and detector parameters are made once,
+ * and the gray image buffer is reused for all frames of the same size.
+ * In tracking mode markers found in the last frame are searched for
+ * in a small area around the predicted position only, the full image is searched
+ * every fullScanInterval frames, or when a marker is not found where predicted.
+ * With a coarse scale, large markers are found in a downscaled image
+ * (corners refined in full resolution), and the full resolution search
+ * is limited to the smaller markers.
+ * Not thread safe - use one detector for each thread. */
+class UArUcoDetector
+{
+public:
+  /**
+   * Constructor
+   * \param dictionaryName is predefined dictionary, e.g. cv::aruco::DICT_4X4_50 */
+  UArUcoDetector(int dictionaryName);
+  /// marker dictionary
+  cv::Ptr<cv::aruco::Dictionary> dictionary;
+  /// detector parameters (may be changed between frames)
+  cv::Ptr<cv::aruco::DetectorParameters> parameters;
+  /**
+   * Detect markers in frame
+   * \param frame is an 8-bit gray or BGR image
+   * \param ids is set to the detected marker IDs
+   * \param corners is set to 4 corners for each detected marker
+   * \returns number of detected markers */
+  int detect(const cv::Mat & frame,
+             std::vector<int> & ids,
+             std::vector<std::vector<cv::Point2f> > & corners);
+  /**
+   * Predicted image motion of markers from last frame to next frame,
+   * e.g. from robot motion, used in tracking mode for the next detect() only.
+   * \param shiftX is horizontal shift in pixels (positive is right)
+   * \param scale is size change (>1 is closer), markers also move away from center
+   * \param center is the image center (principal point) */
+  void predict(float shiftX, float scale, cv::Point2f center);
+  /**
+   * Forget tracked markers, so next frame gets a full image search */
+  void resetTracks()
+  {
+    tracks.clear();
+  }
+  /**
+   * print tracking statistics (one line) */
+  void printStatus();
+  /// gray version of last (BGR) frame
+  cv::Mat gray;
+  /// search near markers found in last frame only
+  bool tracking = false;
+  /// in tracking mode search full image at least every this many frames
+  int fullScanInterval = 10;
+  /// search area is the (predicted) marker bounding box enlarged with
+  /// this factor of the marker size on each side
+  float roiMargin = 0.6;
+  /**
+   * Downscale factor for the full image search, 1 is full resolution only,
+   * 2 finds large markers in half resolution, 4 in quarter resolution.
+   * Small markers can not be decoded in the downscaled image,
+   * so these are always searched for in full resolution */
+  int coarseScale = 1;
+  /**
+   * Markers with a perimeter above this rate (of the largest image dimension, as
+   * DetectorParameters::minMarkerPerimeterRate) are found in the downscaled image,
+   * the full resolution search is limited to markers up to a bit larger than this */
+  float coarsePerimeterRate = 0.2;
+  /**
+   * Detector parameters for the downscaled image,
+   * minMarkerPerimeterRate is set from coarsePerimeterRate */
+  cv::Ptr<cv::aruco::DetectorParameters> coarseParameters;
+  /// average time per frame (ms) for scale and detect in the downscaled image
+  float coarseMs = 0;
+  /// average time per frame (ms) for detection of small markers in full resolution
+  float fineMs = 0;
+  /// average time per frame (ms) for corner refinement of large markers in full resolution
+  float refineMs = 0;
+private:
+  /** search full image */
+  void detectFull(const cv::Mat & im,
+                  std::vector<int> & ids,
+                  std::vector<std::vector<cv::Point2f> > & corners);
+  /**
+   * search near tracked markers only
+   * \returns false if a tracked marker is lost */
+  bool detectTracked(const cv::Mat & im,
+                     std::vector<int> & ids,
+                     std::vector<std::vector<cv::Point2f> > & corners);
+  /** one tracked marker */
+  struct Track
+  {
+    int id;
+    /// bounding box of marker corners in last frame
+    cv::Rect2f box;
+  };
+  std::vector<Track> tracks;
+  /// frames since last full image search
+  int framesSinceFullScan = 0;
+  /// predicted motion for next frame
+  float predShift = 0;
+  float predScale = 1;
+  cv::Point2f predCenter;
+  /// downscaled image for coarse search
+  cv::Mat coarse;
+  /// parameters for full resolution, when limited to small markers
+  cv::Ptr<cv::aruco::DetectorParameters> fineParameters;
+  /// markers found in the downscaled image
+  std::vector<int> coarseIds;
+  std::vector<std::vector<cv::Point2f> > coarseCorners;
+  /// buffers for search in one area
+  std::vector<int> roiIds;
+  std::vector<std::vector<cv::Point2f> > roiCorners;
+  /// statistics
+  int fullScanCnt = 0;
+  int trackedCnt = 0;
+  int lostCnt = 0;
+};
+
+#endif
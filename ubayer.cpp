@@ -0,0 +1,135 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <string.h>
+#include "ubayer.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+void bayer10to8scalar(const uint16_t * src, uint8_t * dst, int n)
+{
+  for (int i = 0; i < n; i++)
+    dst[i] = src[i] >> 2; // remove 2 LSB
+}
+
+void bayer10to8(const uint16_t * src, uint8_t * dst, int n)
+{
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; i <= n - 16; i += 16)
+  { // 16 pixels at a time, shift right and narrow to 8 bit
+    uint16x8_t a = vld1q_u16(src + i);
+    uint16x8_t b = vld1q_u16(src + i + 8);
+    vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(a, 2), vshrn_n_u16(b, 2)));
+  }
+#elif defined(__SSE2__)
+  for (; i <= n - 16; i += 16)
+  { // values are below 256 after the shift, so no saturation in pack
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+    a = _mm_srli_epi16(a, 2);
+    b = _mm_srli_epi16(b, 2);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+  }
+#endif
+  // the rest (or all without SIMD)
+  bayer10to8scalar(src + i, dst + i, n - i);
+}
+
+void bayer10Pto8scalar(const uint8_t * src, uint8_t * dst, int n)
+{
+  for (int i = 0; i < n; i += 4)
+  { // keep the 4 MSB bytes, skip the LSB byte
+    memcpy(dst, src, 4);
+    dst += 4;
+    src += 5;
+  }
+}
+
+void bayer10Pto8(const uint8_t * src, uint8_t * dst, int n)
+{
+  int i = 0;
+#if defined(__aarch64__) || defined(__SSSE3__)
+  // 16 source bytes hold 3 groups of 4 pixels, 
+  // 12 pixels are written per loop (16 bytes stored, the last 4 are overwritten next time)
+  const uint8_t idx[16] = {0,1,2,3, 5,6,7,8, 10,11,12,13, 0,0,0,0};
+#if defined(__aarch64__)
+  uint8x16_t tbl = vld1q_u8(idx);
+  for (; i <= n - 16; i += 12)
+  {
+    uint8x16_t v = vld1q_u8(src);
+    vst1q_u8(dst, vqtbl1q_u8(v, tbl));
+    src += 15;
+    dst += 12;
+  }
+#else
+  __m128i tbl = _mm_loadu_si128((const __m128i *)idx);
+  for (; i <= n - 16; i += 12)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)src);
+    _mm_storeu_si128((__m128i *)dst, _mm_shuffle_epi8(v, tbl));
+    src += 15;
+    dst += 12;
+  }
+#endif
+#endif
+  bayer10Pto8scalar(src, dst, n - i);
+}
+
+void bayer8HalfBGR(const uint8_t * src, int srcStep, uint8_t * dst, int dstStep, int w2, int h2)
+{
+  for (int r = 0; r < h2; r++)
+  {
+    const uint8_t * s0 = src + 2 * r * srcStep; // B G B G ...
+    const uint8_t * s1 = s0 + srcStep;          // G R G R ...
+    uint8_t * d = dst + r * dstStep;
+    for (int c = 0; c < w2; c++)
+    {
+      d[0] = s0[0];
+      d[1] = (s0[1] + s1[0] + 1) >> 1;
+      d[2] = s1[1];
+      s0 += 2;
+      s1 += 2;
+      d += 3;
+    }
+  }
+}
+
+void bayer8HalfGray(const uint8_t * src, int srcStep, uint8_t * dst, int dstStep, int w2, int h2)
+{
+  for (int r = 0; r < h2; r++)
+  {
+    const uint8_t * s0 = src + 2 * r * srcStep;
+    const uint8_t * s1 = s0 + srcStep;
+    uint8_t * d = dst + r * dstStep;
+    for (int c = 0; c < w2; c++)
+    { // luma in 8-bit fixed point, green weight is split on the two greens
+      d[c] = (29 * s0[2 * c] + 75 * (s0[2 * c + 1] + s1[2 * c]) + 77 * s1[2 * c + 1] + 128) >> 8;
+    }
+  }
+}
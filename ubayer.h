@@ -0,0 +1,65 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UBAYER_H
+#define UBAYER_H
+
+#include <stdint.h>
+
+/**
+ * Convert 10-bit Bayer pixels (V4L2_PIX_FMT_SBGGR10, 16 bit per pixel
+ * with the value in the 10 LSB) to 8 bit by removing the 2 LSB.
+ * Uses NEON or SSE2 when available.
+ * \param src is the 10-bit source
+ * \param dst is the 8-bit destination (n bytes)
+ * \param n is the number of pixels */
+void bayer10to8(const uint16_t * src, uint8_t * dst, int n);
+/**
+ * Same as bayer10to8, but without SIMD (reference for test and benchmark) */
+void bayer10to8scalar(const uint16_t * src, uint8_t * dst, int n);
+/**
+ * Convert 10-bit packed Bayer pixels (V4L2_PIX_FMT_SBGGR10P, 4 pixels in 5 bytes,
+ * the first 4 bytes are the 8 MSB of each pixel, the 5th byte has the 2 LSB of all 4)
+ * to 8 bit.
+ * Uses NEON (64-bit ARM) or SSSE3 when available.
+ * \param src is the packed source (n * 5/4 bytes)
+ * \param dst is the 8-bit destination (n bytes)
+ * \param n is the number of pixels (a multiple of 4) */
+void bayer10Pto8(const uint8_t * src, uint8_t * dst, int n);
+/**
+ * Same as bayer10Pto8, but without SIMD */
+void bayer10Pto8scalar(const uint8_t * src, uint8_t * dst, int n);
+/**
+ * Half resolution colour image from 8-bit Bayer (BGGR, i.e. blue at (0,0)),
+ * each 2x2 quad gives one BGR pixel (the two greens are averaged), no demosaicing.
+ * \param src is the Bayer image, starting at an even row and column
+ * \param srcStep is bytes per source line
+ * \param dst is the BGR destination (3 bytes per pixel)
+ * \param dstStep is bytes per destination line
+ * \param w2, h2 is the destination size (half of the source size) */
+void bayer8HalfBGR(const uint8_t * src, int srcStep, uint8_t * dst, int dstStep, int w2, int h2);
+/**
+ * Half resolution gray (luma) image from 8-bit Bayer (BGGR),
+ * each 2x2 quad gives one pixel (0.299 R + 0.587 G + 0.114 B).
+ * Parameters as bayer8HalfBGR, but 1 byte per destination pixel. */
+void bayer8HalfGray(const uint8_t * src, int srcStep, uint8_t * dst, int dstStep, int w2, int h2);
+
+#endif
@@ -0,0 +1,86 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <math.h>
+#include <opencv2/imgproc.hpp>
+#include "ublobs.h"
+
+
+int UBlobFinder::find(const cv::Mat & mask)
+{
+  blobCnt = 0;
+  overflowCnt = 0;
+  int n = cv::connectedComponentsWithStats(mask, labels, stats, centroids, 8, CV_32S);
+  // label 0 is background
+  for (int i = 1; i < n; i++)
+  {
+    const int * s = stats.ptr<int>(i);
+    UBlob b;
+    b.area = s[cv::CC_STAT_AREA];
+    if (b.area < minArea or b.area > maxArea)
+      continue;
+    b.box = cv::Rect(s[cv::CC_STAT_LEFT], s[cv::CC_STAT_TOP], s[cv::CC_STAT_WIDTH], s[cv::CC_STAT_HEIGHT]);
+    int big = b.box.width > b.box.height ? b.box.width : b.box.height;
+    int small = b.box.width < b.box.height ? b.box.width : b.box.height;
+    b.aspect = float(big) / float(small);
+    b.radius = big / 2.0;
+    b.eqRadius = sqrtf(b.area / M_PI);
+    b.circularity = b.area / (M_PI * b.radius * b.radius);
+    if (b.circularity < minCircularity or b.aspect > maxAspect)
+      continue;
+    const double * c = centroids.ptr<double>(i);
+    b.centroid = cv::Point2f(c[0], c[1]);
+    // insert sorted by area, the smallest is dropped when full
+    int k = blobCnt;
+    if (blobCnt < MAX_BLOBS)
+      blobCnt++;
+    else if (b.area <= blobs[MAX_BLOBS - 1].area)
+    {
+      overflowCnt++;
+      continue;
+    }
+    else
+    {
+      overflowCnt++;
+      k = MAX_BLOBS - 1;
+    }
+    while (k > 0 and blobs[k - 1].area < b.area)
+    {
+      blobs[k] = blobs[k - 1];
+      k--;
+    }
+    blobs[k] = b;
+  }
+  if (outerOnly)
+  { // larger blobs are first
+    int n = 0;
+    for (int i = 0; i < blobCnt; i++)
+    {
+      bool inner = false;
+      for (int k = 0; k < n and not inner; k++)
+        inner = (blobs[i].box & blobs[k].box) == blobs[i].box;
+      if (not inner)
+        blobs[n++] = blobs[i];
+    }
+    blobCnt = n;
+  }
+  return blobCnt;
+}
@@ -0,0 +1,90 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UBLOBS_H
+#define UBLOBS_H
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * One connected area (blob) in a binary mask */
+class UBlob
+{
+public:
+  /// number of pixels
+  int area;
+  /// centre of mass (pixels)
+  cv::Point2f centroid;
+  /// bounding box
+  cv::Rect box;
+  /// radius of enclosing circle, estimated as half the largest box side
+  float radius;
+  /// radius of a circle with the same area
+  float eqRadius;
+  /// area relative to the enclosing circle area (1 for a filled circle)
+  float circularity;
+  /// largest box side divided by smallest side (1 or more)
+  float aspect;
+};
+
+/**
+ * Finds all blobs in a binary mask in one pass (connected components),
+ * and keeps the largest blobs that pass the filters, sorted by area.
+ * The storage is fixed (MAX_BLOBS) and the buffers are reused for every image. */
+class UBlobFinder
+{
+public:
+  /// max number of blobs kept (the largest)
+  static const int MAX_BLOBS = 32;
+  /// filters
+  int minArea = 1;
+  int maxArea = 1 << 30;
+  float minCircularity = 0;
+  float maxAspect = 1000;
+  /**
+   * Skip blobs inside the bounding box of a larger blob, e.g. a blob in a hole,
+   * as outer contours only (RETR_EXTERNAL) */
+  bool outerOnly = false;
+  /// found blobs, largest first
+  UBlob blobs[MAX_BLOBS];
+  /// number of valid blobs
+  int blobCnt = 0;
+  /// blobs that passed the filters, but were not kept
+  int overflowCnt = 0;
+  /**
+   * Find blobs
+   * \param mask is 8-bit binary image (not zero is foreground)
+   * \returns number of blobs kept (blobCnt) */
+  int find(const cv::Mat & mask);
+  /**
+   * Largest blob, or NULL if none */
+  const UBlob * largest() const
+  {
+    if (blobCnt > 0)
+      return &blobs[0];
+    return NULL;
+  }
+private:
+  /// connected component buffers
+  cv::Mat labels, stats, centroids;
+};
+
+#endif
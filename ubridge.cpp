@@ -32,6 +32,7 @@
 #include <math.h>
 #include <string.h>
 #include <termios.h>
+#include <time.h>
 // #include <opencv2/core/core.hpp>
 // #include <opencv2/highgui/highgui.hpp>
 
@@ -47,7 +48,13 @@ UBridge::UBridge(const char * server, bool openlog)
   th1stop = false;
   th1 = NULL;
   tickClassIdx = 0;
+  txTokens = txBurst;
+  txTime.now();
 //   printf("UBridge:: opening socket to bridge\n");
+  botlog = NULL;
+  // bridge status messages are not used,
+  // registered before the receive thread uses the table
+  registerMessage("bridge", NULL, NULL);
   createSocket("24001", server);
   tryConnect();
   if (connected)
@@ -55,20 +62,48 @@ UBridge::UBridge(const char * server, bool openlog)
 //     printf("UBridge:: connected to bridge\n");
     th1 = new thread(runObj, this);
   }
-  botlog = NULL;
   if (openlog)
     openLog();
 }
 
 /////////////////////////////////////////////////////////
 
+bool UDecodeTable::add(const char * tag, UData * item, UDecodeFunc func)
+{
+  char t[5] = "    ";
+  strncpy(t, tag, 4);
+  if (t[3] == '\0')
+    // 3 character tag, is followed by a space
+    t[3] = ' ';
+  uint32_t key = getKey(t);
+  if (count >= TABLE_SIZE - 1 or find(t) != NULL)
+    return false;
+  int i = slot(key);
+  while (table[i].key != 0)
+    i = (i + 1) & (TABLE_SIZE - 1);
+  table[i].key = key;
+  table[i].item = item;
+  table[i].func = func;
+  count++;
+  return true;
+}
+
+/////////////////////////////////////////////////////////
+
+void UBridge::registerMessage(const char * tag, UData * item, UDecodeFunc func)
+{
+  if (not msgTable.add(tag, item, func))
+    printf("UBridge::registerMessage: failed to register '%s' (already used or table full)\n", tag);
+}
+
+/////////////////////////////////////////////////////////
+
 /** destructor */
 UBridge::~UBridge()
 { // stop all activity before close
   printf("Bridge destructor\n");
   stop();
-  if (botlog != NULL)
-    fclose(botlog);
+  closeLog();
 }
 
 /////////////////////////////////////////////////////////
@@ -83,22 +118,22 @@ void UBridge::openLog()
   time.now();
   time.getForFilename(date);
   snprintf(name, MNL, "log_rx_tx_%s.txt", date);
-  botlog=fopen(name,"w");
-  if (botlog != NULL)
+  FILE * log = fopen(name,"w");
+  if (log != NULL)
   {
     timeval t;
     gettimeofday(&t, NULL);
     float dt = getTimeDiff(t, info->bootTime);
-    logMtx.lock();
-    fprintf(botlog, "%% log of mission messages transmitted to bridge (outgoing) (<-)\n");
-    fprintf(botlog, "%% received from bridge (incoming) (->)\n");
-    fprintf(botlog, "%% 1 Linux timestamp (seconds since 1 jan 1970)\n");
-    fprintf(botlog, "%% 2 mission time (sec)\n");
-    fprintf(botlog, "%% 3 direction flag ->: or <-:\n");
-    fprintf(botlog, "%% 4 string send or received\n");
-    fprintf(botlog, "%lu.%03ld %6.3f->: %s %d\n", t.tv_sec, t.tv_usec/1000, dt, "Connected to bridge ", connected);
-    fflush(botlog);
-    logMtx.unlock();
+    fprintf(log, "%% log of mission messages transmitted to bridge (outgoing) (<-)\n");
+    fprintf(log, "%% received from bridge (incoming) (->)\n");
+    fprintf(log, "%% 1 Linux timestamp (seconds since 1 jan 1970)\n");
+    fprintf(log, "%% 2 mission time (sec)\n");
+    fprintf(log, "%% 3 direction flag ->: or <-:\n");
+    fprintf(log, "%% 4 string send or received\n");
+    fprintf(log, "%lu.%03ld %6.3f->: %s %d\n", t.tv_sec, t.tv_usec/1000, dt, "Connected to bridge ", connected);
+    fflush(log);
+    // header is written, now available to other threads
+    botlog = log;
   }
 }
 
@@ -106,11 +141,10 @@ void UBridge::openLog()
 
 void UBridge::closeLog()
 {
-  if (botlog != NULL)
-  {
-    fclose(botlog);
-    botlog = NULL;
-  }
+  // new users see NULL, lines from current users are dropped by the log writer
+  FILE * f = botlog.exchange(NULL);
+  if (f != NULL)
+    logWriter.close(f);
 }
 
 /////////////////////////////////////////////////////////
@@ -128,38 +162,87 @@ void UBridge::stop()
 /**
   * send a string to the serial port */
 void UBridge::send(const char * cmd)
+{ // this function may be called by more than one thread
+  sendBatch(&cmd, 1);
+}
+
+/////////////////////////////////////////////////////////
+
+void UBridge::sendBatch(const char * cmds[], int cmdCnt)
 { // this function may be called by more than one thread
   // so make sure that only one send at any one time
-//   printf("UBridge::send 0\n");
   sendMtx.lock();
   if (connected)
-  { // send data
-//     sleep(1);
-//    printf("UBridge::send 2-\n");
-    sendData(cmd);
-//     printf("UBridge::send 2+ %s", cmd);
-    // debug
+  { // join commands into as few writes as possible
+    int n = 0;
+    int k = 0;
+    for (int i = 0; i < cmdCnt; i++)
     {
-      timeval t;
-      gettimeofday(&t, NULL);
-      float dt = getTimeDiff(t, info->bootTime);
-      if (botlog != NULL)
+      int len = strlen(cmds[i]);
+      if (n > 0 and (n + len >= MAX_TX_CNT or k >= txBurst))
+      { // no more space, send what we have
+        sendTx(n, k);
+        n = 0;
+        k = 0;
+      }
+      if (len >= MAX_TX_CNT)
+        printf("UBridge::sendBatch: command too long (%d chars) - skipped\n", len);
+      else
       {
-        logMtx.lock();
-        fprintf(botlog, "%lu.%03ld %6.3f->: %s", t.tv_sec, t.tv_usec/1000, dt, cmd);
-        fflush(botlog);
-        logMtx.unlock();
+        memcpy(&tx[n], cmds[i], len);
+        n += len;
+        k++;
       }
-//       printf("UBridge::send %6.3f->: %s", dt, cmd);
     }
+    if (n > 0)
+      sendTx(n, k);
   }
-  // 
-  usleep(4000); // Short sleep helps communication be more reliable when many command lines are send consecutively.
   sendMtx.unlock();
 }
 
 /////////////////////////////////////////////////////////
 
+void UBridge::sendTx(int txCnt, int cmdCnt)
+{ // flow control - wait only if more than the allowed burst is send
+  UTime t;
+  t.now();
+  txTokens += (t - txTime) * txCmdsPerSec;
+  if (txTokens > txBurst)
+    txTokens = txBurst;
+  txTime = t;
+  if (txTokens < cmdCnt)
+  { // wait until there is room for these commands
+    usleep(int((cmdCnt - txTokens) / txCmdsPerSec * 1e6));
+    txTime.now();
+    txTokens = cmdCnt;
+  }
+  txTokens -= cmdCnt;
+  tx[txCnt] = '\0';
+  sendData(tx);
+  // closeLog() may clear botlog at any time, so use one copy
+  FILE * log = botlog;
+  if (log != NULL)
+  { // log each command
+    timeval t;
+    gettimeofday(&t, NULL);
+    float dt = getTimeDiff(t, info->bootTime);
+    char * p1 = tx;
+    while (*p1 != '\0')
+    {
+      char * p2 = strchr(p1, '\n');
+      if (p2 == NULL)
+        // last command has no newline
+        p2 = &tx[txCnt];
+      logWriter.print(log, "%lu.%03ld %6.3f->: %.*s\n", t.tv_sec, t.tv_usec/1000, dt, int(p2 - p1), p1);
+      if (*p2 == '\0')
+        break;
+      p1 = p2 + 1;
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////
+
 /**
   * receive thread */
 void UBridge::run()
@@ -168,68 +251,45 @@ void UBridge::run()
   rxCnt = 0;
   int msgCnt = 0;
   int msgCntSec =0;
-  timeval idleTime;
-  gettimeofday(&idleTime, NULL);
   bool sockErr = false;
-  UTime t, tsec;
+  UTime t, tsec, tLoad;
   t.Now();
   tsec = t + 1;
-  int loopSec = 0;
-  int sleepUs = 1000;
+  tLoad = t;
+  // CPU time used by this thread at last load calculation
+  timespec cpuLoad;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuLoad);
   // get robot name
   //send("u4\n");
-  int loop = 0;
   while (not th1stop)
-  {
-    char c;
-    n = readChar(&c, &sockErr);
-    if (n == 1)
-    { // not an error or hangup
-      if (c >=' ' or c == '\n')
-      { // got a valid character
-        rx[rxCnt] = c;
-        if (rx[rxCnt] == '\n')
-        { // terminate string
-          rx[rxCnt] = '\0';
-          // printf("#### Received: (loop=%d, rxCnt=%d) '%s'\n",loop, rxCnt, rx);
-          decode(rx);
-          rxCnt = 0;
-          msgCnt++;
-          // clear buffer for old message
-          memset(rx, '\0', MAX_RX_CNT);
-          n = 0;
-          gettimeofday(&idleTime, NULL);
-        }
-        else if (rxCnt < MAX_RX_CNT)
-        { // prepare for next byte
-          rxCnt++;
-          continue;
-        }
-        else
-        { // buffer overflow
-          printf("UBridge::run: receiver overflow\n");
-          rxCnt = 0;
-        }
-      }
+  { // wait for data - timeout to keep load and stop flag updated
+    n = readBlock(&rx[rxCnt], RX_BUF_SIZE - rxCnt - 1, 100, &sockErr);
+    if (n > 0)
+    { // decode all complete lines in this block
+      rxCnt += n;
+      msgCnt += decodeRxBuffer();
     }
     else if (sockErr)
     {
       perror("UBridge:: port error");
       usleep(100000);
     }
-    // go idle a bit
-    usleep(sleepUs);
-    loop++;
     t.now();
     if (t > tsec)
-    {
-      int loops = loop - loopSec;
-      loopSec = loop;
-      int sleptUs = loops * sleepUs;
-      info->bridgeLoad = (1000000 - sleptUs) * 100.0 / 1000000.0;
-      info->msgCnt1sec = msgCnt - msgCntSec;
+    { // load is CPU time used by this thread since last calculation
+      timespec cpu;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+      float used = float(cpu.tv_sec - cpuLoad.tv_sec) + float(cpu.tv_nsec - cpuLoad.tv_nsec) / 1e9;
+      float dt = t - tLoad;
+      if (dt > 0.0)
+      {
+        info->bridgeLoad = used * 100.0 / dt;
+        info->msgCnt1sec = roundf((msgCnt - msgCntSec) / dt);
+      }
+      cpuLoad = cpu;
+      tLoad = t;
       msgCntSec = msgCnt;
-//       printf("# bridge load = %.1f %% (loops = %d, sleepUs=%d, msg cnt=%d/sec)\n", info->bridgeLoad, loops, sleepUs, info->msgCnt1sec);
+//       printf("# bridge load = %.1f %% (msg cnt=%d/sec)\n", info->bridgeLoad, info->msgCnt1sec);
       tsec += 1;
       info->saveDataToLog();
     }
@@ -239,6 +299,40 @@ void UBridge::run()
 
 /////////////////////////////////////////////////////////
 
+int UBridge::decodeRxBuffer()
+{ // split into lines in place, and skip control characters
+  int msgCnt = 0;
+  char * lineStart = rx;
+  char * dst = rx;
+  char * end = &rx[rxCnt];
+  for (char * p1 = rx; p1 < end; p1++)
+  {
+    if (*p1 == '\n')
+    { // terminate string
+      *dst = '\0';
+      decode(lineStart);
+      msgCnt++;
+      lineStart = p1 + 1;
+      dst = lineStart;
+    }
+    else if (*p1 >= ' ')
+      // got a valid character
+      *dst++ = *p1;
+  }
+  // keep the partial line for next block
+  rxCnt = dst - lineStart;
+  if (rxCnt >= MAX_RX_CNT)
+  { // buffer overflow
+    printf("UBridge::run: receiver overflow\n");
+    rxCnt = 0;
+  }
+  else if (rxCnt > 0 and lineStart != rx)
+    memmove(rx, lineStart, rxCnt);
+  return msgCnt;
+}
+
+/////////////////////////////////////////////////////////
+
 /**
   * decode messages from REGBOT */
 void UBridge::decode(char * message)
@@ -250,53 +344,14 @@ void UBridge::decode(char * message)
   // printf("UBridge::decode:: got:%s\n", message);
   // debug end
   if (*message != '\0')
-  {
-    if (strncmp(message, "hbt ", 4) == 0)
-      info->decodeHbt(message); // it is a heartbeat message (time and battry voltage)
-    else if (strncmp(message, "pse ", 4) == 0)
-      pose->decode(message); // it is a pose message
-    else if (strncmp(message, "lip ", 4) == 0)
-      edge->decode(message); // it is a line edge message
-    else if (strncmp(message, "event", 5)==0)
+  { // find decoder from message tag
+    const UDecodeTable::Entry * e = msgTable.find(message);
+    if (e != NULL)
     {
-      event->decode(message);
-//       t.now();
-//       printf("%ld.%03ld UBridge::decode: %s\n", t.getSec(), t.getMilisec(), message);
-    }
-    else if (strncmp(message, "mis ", 4)==0)
-      info->decodeMission(message); // mission status skipped
-    else if (strncmp(message, "rid ", 4)==0)
-      info->decodeId(message); // mission status skipped
-    else if (strncmp(message, "joy ", 4)==0)
-    {
-      joy->decode(message); // 
-    }
-    else if (strncmp(message, "wve ", 4)==0)
-    { // wheel velocity
-      motor->decodeVel(message);
-    }
-    else if (strncmp(message, "mca ", 4)==0)
-    { // motor current
-      motor->decodeCurrent(message);
-    }
-    else if (strncmp(message, "irc ", 4)==0)
-    { // motor current
-      irdist->decode(message);
-    }
-    else if (strncmp(message, "acw ", 4)==0)
-    { // motor current
-//       printf("\n#UBridge:: decoding acw\n");
-      imu->decode(message);
-//       printf("#UBridge:: decoded acw\n");
-    }
-    else if (strncmp(message, "gyw ", 4)==0)
-    { // motor current
-      imu->decode(message);
+      if (e->func != NULL)
+        e->func(e->item, message);
+      // else known, but skipped
     }
-    else if (strncmp(message, "rid ", 4)==0)
-      ; // robot ID skipped
-    else if (strncmp(message, "bridge", 6)==0)
-      ; // skipped bridge
     else if (*message == '#')
       // just a message from Regbot
       printf("%s\n", message);
@@ -305,14 +360,14 @@ void UBridge::decode(char * message)
       printf("UBridge:: unhandled message: '%s'\n", message);
     }
   }
-  if (botlog != NULL)
+  // closeLog() may clear botlog at any time, so use one copy
+  FILE * log = botlog;
+  if (log != NULL)
   {
     timeval t;
     gettimeofday(&t, NULL);
     float dt = getTimeDiff(t, info->bootTime);
-    logMtx.lock();
-    fprintf(botlog, "%lu.%03ld %.1f%%, %6.3f<-: %s\n", t.tv_sec, t.tv_usec/1000, info->bridgeLoad, dt, message);
-    logMtx.unlock();
+    logWriter.print(log, "%lu.%03ld %.1f%%, %6.3f<-: %s\n", t.tv_sec, t.tv_usec/1000, info->bridgeLoad, dt, message);
   }
 }
 
@@ -332,6 +387,8 @@ void UBridge::printStatus()
   motor->printStatus();
   irdist->printStatus();
   imu->printStatus();
+  logWriter.printStatus();
+  telemetry.printStatus();
 }
 
 int UBridge::decodeLogOpenOrClose(const char c, UData * item)
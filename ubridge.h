@@ -27,20 +27,95 @@
 // #include <sstream>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <math.h>
+#include <stdint.h>
 // #include <opencv2/core/core.hpp>
 // #include <opencv2/highgui/highgui.hpp>
 #include "urun.h"
 #include "tcpCase.h"
 #include "utime.h"
+#include "useqlock.h"
+#include "ulog.h"
+#include "urecorder.h"
+#include "ulibpose.h"
 
 using namespace std;
 // forward declaration
 class UBridge;
+class UData;
+
+/**
+ * function that decodes one message type into a data item */
+typedef void (*UDecodeFunc)(UData * item, char * msg);
+
+/**
+ * Message dispatch table.
+ * A message is identified by its first 4 characters (the tag),
+ * packed into an uint32 key, e.g. "pse " or "even" (for "event").
+ * The table is hashed with a fixed multiplier, that gives no collisions
+ * for the current message set, so lookup is one probe (linear probing
+ * handles collisions for tags added later). */
+class UDecodeTable
+{
+public:
+  struct Entry
+  {
+    uint32_t key;
+    UData * item;
+    UDecodeFunc func;
+  };
+  /// table size - must be a power of 2 (64 = 2^6)
+  static const int TABLE_SIZE = 64;
+  static const int TABLE_BITS = 6;
+  /**
+   * Add a decode function for a message tag.
+   * \param tag is the message tag (3 or 4 characters), a 3 character tag is padded with a space.
+   * \param item is the data item to pass to the decode function.
+   * \param func is the decode function, may be NULL to ignore the message type.
+   * \returns false if table is full or tag is already used */
+  bool add(const char * tag, UData * item, UDecodeFunc func);
+  /**
+   * Find entry for this message
+   * \returns NULL if message tag is not registered */
+  inline const Entry * find(const char * msg) const
+  {
+    uint32_t key = getKey(msg);
+    int i = slot(key);
+    while (table[i].key != 0)
+    {
+      if (table[i].key == key)
+        return &table[i];
+      i = (i + 1) & (TABLE_SIZE - 1);
+    }
+    return NULL;
+  }
+  /**
+   * Pack the first (up to) 4 characters of a string into a key */
+  static inline uint32_t getKey(const char * msg)
+  {
+    uint32_t key = 0;
+    for (int i = 0; i < 4 and msg[i] != '\0'; i++)
+      key |= uint32_t((unsigned char)msg[i]) << (i * 8);
+    return key;
+  }
+  /** number of registered tags */
+  inline int getCount() { return count; }
+private:
+  /** hash a key to a table index */
+  static inline int slot(uint32_t key)
+  {
+    return (key * 0xc386bbc5u) >> (32 - TABLE_BITS);
+  }
+  Entry table[TABLE_SIZE] = {};
+  int count = 0;
+};
+
 
 /////////////////////////////////////////////////////////////
 
@@ -75,9 +150,10 @@ public:
   // close logfile
   void closeLog()
   {
-    if (logfile != NULL)
-      fclose(logfile);
+    FILE * f = logfile;
     logfile = NULL;
+    if (f != NULL)
+      logWriter.close(f);
   }
   // is log open
   inline bool logIsOpen() { return logfile != NULL; }
@@ -110,6 +186,13 @@ class UIRdist : public UData
 public:
   float dist[2] = {0,0};
   int raw[2] = {0,0};
+  /// consistent set of values from one message
+  struct Snapshot
+  {
+    timeval time;
+    float dist[2];
+    int raw[2];
+  };
   // constructor
   UIRdist(UBridge * bridge_ptr, bool openLog);
   //
@@ -121,6 +204,14 @@ public:
   /**
    * Print status for bridge and all data elements */
   void printStatus();
+  /**
+   * Get latest values - never blocks the bridge thread */
+  inline Snapshot snapshot() const
+  {
+    return snap.read();
+  }
+private:
+  USeqLock<Snapshot> snap;
 };
 
 /**
@@ -130,6 +221,13 @@ class UAccGyro : public UData
 public:
   float acc[3] = {0};
   float gyro[3] = {0};
+  /// consistent set of accelerometer and gyro values
+  struct Snapshot
+  {
+    timeval time;
+    float acc[3];
+    float gyro[3];
+  };
   // constructor
   UAccGyro(UBridge * bridge_ptr, bool openLog);
   //
@@ -144,6 +242,14 @@ public:
   /**
    * get turnrate */
   float turnrate();
+  /**
+   * Get latest values - never blocks the bridge thread */
+  inline Snapshot snapshot() const
+  {
+    return snap.read();
+  }
+private:
+  USeqLock<Snapshot> snap;
 };
 
 /**
@@ -156,6 +262,16 @@ public:
   float h = 0.0;
   float tilt = 0.0;
   float dist = 0.0;
+  /// consistent pose from one message
+  struct Snapshot
+  {
+    timeval time;
+    float x;
+    float y;
+    float h;
+    float tilt;
+    float dist;
+  };
   // constructor
   UPoseInfo(UBridge * bridge_ptr, bool openLog);
   //
@@ -167,6 +283,40 @@ public:
   /**
    * Print status for bridge and all data elements */
   void printStatus();
+  /**
+   * Get latest pose - never blocks the bridge thread,
+   * use this rather than x, y and h, when they need to match */
+  inline Snapshot snapshot() const
+  {
+    return snap.read();
+  }
+  /**
+   * Get robot pose at a time in the (recent) past, e.g. when an image was captured.
+   * The pose is interpolated between the two nearest pose messages, or
+   * extrapolated from the two newest, if the time is after the newest pose.
+   * \param atTime is the time of interest (linux time)
+   * \param pose is where the result is returned
+   * \returns false if there is no pose history at this time (then pose is oldest available) */
+  bool poseAt(UTime atTime, UPose * pose);
+  /// pose history size - about 10 seconds at 100 poses per second
+  static const int HISTORY_SIZE = 1024;
+private:
+  USeqLock<Snapshot> snap;
+  /// one pose in history
+  struct HistSample
+  {
+    timeval time;
+    float x, y, h;
+    uint32_t n;
+  };
+  /**
+   * get pose history sample with this (absolute) number
+   * \returns false if overwritten by newer data */
+  bool getHistory(uint32_t n, UPoseTime * pt);
+  /// pose history ring, each sample with its own sequence lock
+  USeqLock<HistSample> history[HISTORY_SIZE];
+  /// number of poses added to history
+  std::atomic<uint32_t> historyCnt = {0};
 };
 
 /////////////////////////////////////////////////////////////
@@ -248,9 +398,16 @@ class UEvent  : public UData
 {
 public:
   static const int MAX_EVENT_FLAGS = 34;
-  bool eventFlags[MAX_EVENT_FLAGS];
+  /**
+   * Event flags, bit n is event n.
+   * set by the bridge thread, tested (and cleared) lock-free by the mission */
+  std::atomic<uint64_t> eventFlags = {0};
+  /** lock for waiting for an event (and for the event set time) */
   mutex eventUpdate;
   bool firstEvent = true;
+  /** latency (ms) from event received to waiting thread running, -1 if not waited yet */
+  float waitLatencyMs = -1;
+  float waitLatencyMsMax = 0;
   
   UEvent(UBridge * bridge_ptr, bool openLog);
   //
@@ -270,11 +427,38 @@ public:
    * \param event the event flag to test
    * \returns true and resets event, if it was set */
   bool isEventSet ( int event );
+  /**
+   * Wait (sleeping) until this event is received, then reset the event.
+   * \param event the event flag to wait for
+   * \param timeout is the maximum wait time in seconds, 0 (or less) is no timeout
+   * \returns the wake-up latency in ms (from event received to return),
+   * or -1 if the event did not occur within the timeout */
+  float waitFor(int event, float timeout);
+  /**
+   * Wait (sleeping) until one of the events in the mask is received,
+   * the lowest numbered of these events is reset.
+   * \param mask bit n is set to wait for event n
+   * \param timeout is the maximum wait time in seconds, 0 (or less) is no timeout
+   * \param event is set to the received event number (if not NULL)
+   * \returns the wake-up latency in ms, or -1 on timeout */
+  float waitForAny(uint64_t mask, float timeout, int * event = NULL);
   
   void subscribe() override;
   /**
    * Print status for bridge and all data elements */
   void printStatus();
+  
+private:
+  /**
+   * Reset the lowest set event in mask.
+   * \returns the event number or -1 if none of the events were set */
+  int takeEvent(uint64_t mask);
+  /** write a cleared event to the logfile */
+  void logCleared(int event);
+  /** signalled when an event is set */
+  condition_variable eventSignal;
+  /** time each event was received */
+  timeval eventTime[MAX_EVENT_FLAGS];
 };
 
 /////////////////////////////////////////////////////////////
@@ -314,8 +498,17 @@ public:
 class UMotor  : public UData
 {
 public:
-  float velocity[2];
-  float current[2];
+  float velocity[2] = {0,0};
+  float current[2] = {0,0};
+  /// consistent set of motor values
+  struct Snapshot
+  {
+    timeval time;
+    float velocity[2];
+    float current[2];
+    /// time of first velocity message after robot was stopped
+    timeval moveStart;
+  };
   
   UMotor(UBridge * bridge_ptr, bool openLog);
   //
@@ -333,6 +526,19 @@ public:
   {
     return (velocity[0] + velocity[1])/2.0;
   }
+  /**
+   * Get latest values - never blocks the bridge thread */
+  inline Snapshot snapshot() const
+  {
+    return snap.read();
+  }
+private:
+  /// publish current values
+  void publish();
+  USeqLock<Snapshot> snap;
+  /// is robot moving (from velocity)
+  bool moving = false;
+  timeval moveStart = {0, 0};
 };
 
 /////////////////////////////////////////////////////////////
@@ -345,6 +551,10 @@ public:
  * and this class is the interface to that. */
 class UBridge : public URun, public tcpCase
 { // REGBOT interface
+private:
+  // message dispatch table - declared before the data items,
+  // as they register their message tags when created
+  UDecodeTable msgTable;
 public:
   // data items
   // the second parameter is 
@@ -356,16 +566,32 @@ public:
   UMotor * motor = new UMotor(this, false);
   UIRdist * irdist = new UIRdist(this, false);
   UAccGyro * imu = new UAccGyro(this, false);
-  // debug log
-  FILE * botlog;
+  // debug log (cleared before close, so users should read it once)
+  std::atomic<FILE*> botlog = {NULL};
+  /**
+   * Flow control for commands to REGBOT (token bucket).
+   * Up to txBurst commands are send in one write, after that the
+   * average rate is limited to txCmdsPerSec.
+   * REGBOT does not acknowledge commands, so the default is the rate that is
+   * known to work: one command every 4ms (the fixed sleep used before),
+   * but with no wait after the last command.
+   * A larger burst is faster, but is not tested against the REGBOT receive buffer. */
+  float txCmdsPerSec = 250;
+  int txBurst = 1;
   
 private:
   // mutex to ensure commands to regbot are not mixed
   mutex sendMtx;
-  mutex logMtx;
-  // receive buffer
+  // transmit buffer for batched commands
+  static const int MAX_TX_CNT = 2000;
+  char tx[MAX_TX_CNT];
+  // flow control - commands that may be send now, and time of last update
+  float txTokens = 0;
+  UTime txTime;
+  // receive buffer - holds a full kernel read plus a partial line
   static const int MAX_RX_CNT = 500;
-  char rx[MAX_RX_CNT];
+  static const int RX_BUF_SIZE = 4096;
+  char rx[RX_BUF_SIZE];
   // number of characters in rx buffer
   int rxCnt;
   // status message sequence (fast (sensors))
@@ -400,6 +626,18 @@ public:
   /**
    * send a string to the serial port */
   void send(const char * cmd);
+  /**
+   * Send a number of commands as few socket writes as possible,
+   * the commands are not mixed with commands from other threads.
+   * \param cmds is an array of c-strings, each terminated with a newline.
+   * \param cmdCnt is the number of commands in array. */
+  void sendBatch(const char * cmds[], int cmdCnt);
+  /**
+   * Register decode function for a message type from the bridge
+   * \param tag is the first 3 or 4 characters of the message, e.g. "pse" or "event"
+   * \param item is the data item that is passed to the decode function
+   * \param func is the decode function, NULL if message type is to be ignored */
+  void registerMessage(const char * tag, UData * item, UDecodeFunc func);
   /**
    * receive thread */
   void run();
@@ -428,6 +666,11 @@ private:
   /**
    * decode messages from REGBOT */
   void decode(char * msg);
+  /**
+   * Split received data in rx buffer into lines, and decode all complete lines.
+   * A partial line is moved to the start of the buffer.
+   * \returns number of decoded messages */
+  int decodeRxBuffer();
   /** decode event message */
 //   void decodeEvent(char * msg);
   /** decode heartbeat message */
@@ -440,6 +683,12 @@ private:
   void decodeMissionStatus(char * msg);
   /** send regulat status requests, if no other traffic */
   void requestDataTick();
+  /**
+   * Send the txCnt bytes in tx buffer, when allowed by flow control,
+   * and log the commands (if log is open)
+   * (sendMtx must be locked)
+   * \param cmdCnt is the number of commands in the tx buffer */
+  void sendTx(int txCnt, int cmdCnt);
   /**
    * time (for debug print) */
   UTime t;
@@ -85,7 +85,10 @@ bool UCamera::setupCamera()
   Size: Discrete 640x480 */
   //
   dev_name = "/dev/video0";
-  io = IO_METHOD_MMAP; // use (4) memory mapped buffers 
+  io = IO_METHOD_MMAP; // use memory mapped buffers
+  // frames are leased by the pipeline stages until converted,
+  // so a few more than the (default 4) buffers
+  bufferCount = 6;
   //   w = 2592;
   //   h = 1944;
   //
@@ -141,6 +144,7 @@ void UCamera::stop()
   th1stop = true;
   if (th1 != NULL)
     th1->join();
+  stopPipeline();
 #ifdef raspicam_CV_LIBS
 #else
   if (cameraOpen)
@@ -166,6 +170,14 @@ void UCamera::printStatus()
          camRot[1] * 180 / M_PI, 
          camRot[2] * 180 / M_PI);
   printf("# frame size (h,w)=(%d, %d)/s\n", h, w);
+  printf("# capture mode %d (0=BGR, 1=gray, 2=half BGR, 3=half gray)\n", captureMode);
+  printf("# %d driver buffers, %d frames leased, %d lease failed (all buffers leased)\n", 
+         bufferCount, leaseCnt.load(), leaseFailCnt);
+  printf("# %d failed captures, vision pipeline stages:\n", captureFailCnt);
+  convertStage.printStatus();
+  arucoStage.printStatus();
+  publishStage.printStatus();
+  imageSaver.printStatus();
   arUcos->printStatus();
 }
 
@@ -173,6 +185,7 @@ void UCamera::printStatus()
 
 /** Constructor */
 UCamera::UCamera(UBridge * reg)
+  : convertStage(this), arucoStage(this), publishStage(this)
 {
   th1 = NULL;
   th1stop = false;
@@ -182,6 +195,9 @@ UCamera::UCamera(UBridge * reg)
   cameraOpen = setupCamera();
   // initialize coordinate conversion
   makeCamToRobotTransformation();
+  // connect pipeline stages
+  convertStage.addNext(&arucoStage);
+  convertStage.addNext(&publishStage);
 //   if (cameraOpen)
 //   { // start camera thread
 //     th1 = new thread(runObj, this);
@@ -309,107 +325,32 @@ int getAverageIntensity(cv::Mat im)
 //////////////////////////////////////////////////
 
 /**
- * Thread that keeps frame buffer empty
- * and handles all image events 
+ * Camera thread - keeps the frame buffers empty
+ * and gives the frames to the vision pipeline
  */
 void UCamera::run()
 {
-  cv::Mat im; //, frame;
-//   cv::Mat im2;
-//   cv::Mat imd; // differense image
-//   int lineState = 0;
-//   UTime imTime, im2Time;
-//   bool isOK = false;
-//   printf("# camera thread started\n");
-  UTime t;
-  float dt = 0;
   saveImage = false;
   doArUcoAnalysis = false;
   doArUcoLoopTest = false;
-  int arucoLoop = 100;
-  bool isOK = true;
-  while (not th1stop and cameraOpen)
+  startPipeline();
+  while (not th1stop)
   {
     if (cameraOpen)
-    {
-      // capture RGB image to a Mat structure
-      isOK = capture(im);
-      if (not isOK)
-      {
-        printf("# failed to get an image %d\n", imageNumber);
+    { // wait for next frame from driver (up to 2 seconds)
+      UFrameLease raw = leaseFrame();
+      if (not raw)
+      { // all buffers in use, or no frame
+        captureFailCnt++;
+        usleep(1000);
         continue;
       }
-      if (im.rows > 10 and im.cols > 10)
-      { // there is an image
-#ifdef raspicam_CV_LIBS
-        imageNumber++;
-#else
-        imageNumber++;
-        // debug
-        if (imageNumber > 0 and imageNumber %10 == 0 and arUcos->debugImages)
-        {
-          printStatus();
-          const int MSL = 60;
-          char s[MSL], s2[MSL];
-          snprintf(s, MSL, "saved_image_%s.png", imTime.getForFilename(s2, true));
-          cv::imwrite(s, im);
-          // debug
-          if (imageNumber*3 < 1200)
-            setExposure(imageNumber*3);
-          else
-            printf("##### finished exposure range #####\n");
-          // debug end
-        }
-#endif
-        if (false and imageNumber %10 == 5)
-        {
-          cv::imshow("Debug window", im);
-        }
-        if (logImg != NULL)
-        { // save to image logfile
-          fprintf(logImg, "%ld.%03ld %.3f %d %d %d\n", 
-                  imTime.getSec(), imTime.getMilisec(), 
-                  bridge->info->regbotTime, imageNumber,
-                  saveImage, doArUcoAnalysis);
-        }
-        // test function to access pixel values
-        //imgAverage = getAverageIntensity(im);
-        // 
-        // test for required actions
-        if (saveImage)
-        { // save image as PNG file (takes lots of time to compress and save to flash)
-          //printf("# saving - avg=%d\n", imgAverage);
-          saveImageAsPng(im);
-          printf("Image saved\n");
-          //
-          saveImage = false;
-        }
-        if (doArUcoAnalysis)
-        { // do ArUco detection
-          arUcos->doArUcoProcessing(im, imageNumber, imTime);
-          doArUcoAnalysis = false;
-          // robot pose is set after the processing, it is more likely that
-          // the pose is updated while processing.
-          // this is a bad idea, if robot is moving while grabbing images.
-          arUcos->setPoseAtImageTime(bridge->pose->x, bridge->pose->y, bridge->pose->h);
-        }
-        if (doArUcoLoopTest and arucoLoop > 0)
-        { // timing test - 100 ArUco analysis on 100 frames
-          if (arucoLoop == 100)
-            dt = 0;
-          arucoLoop--;
-          t.now();
-          arUcos->doArUcoProcessing(im, imageNumber, imTime);
-          dt += t.getTimePassed();
-          usleep(10000);
-          if (arucoLoop == 0)
-          { // finished
-            printf("# average ArUco analysis took %.2f ms\n", dt/100 * 1000);
-            doArUcoLoopTest = false;
-            arucoLoop = 100;
-          }
-        }
-      }
+      imageNumber++;
+      UVisionFramePtr frame(new UVisionFrame());
+      frame->raw = raw;
+      frame->imTime = raw->time;
+      frame->number = imageNumber;
+      convertStage.push(frame);
     }
     else if (doArUcoAnalysis or saveImage)
     { // no camera
@@ -418,18 +359,149 @@ void UCamera::run()
       doArUcoAnalysis = false;
       sleep(1);
     }
-    // wait a bit
-    usleep(1000);
+    else
+      usleep(10000);
   }
+  stopPipeline();
   printf("Camera functions ended\n");
 }
 
+void UCamera::startPipeline()
+{
+  imageSaver.start(imageSaverThreads);
+  convertStage.start();
+  arucoStage.start();
+  publishStage.start();
+}
+
+void UCamera::stopPipeline()
+{ // stop in data flow order, so no frame lease is left in a queue
+  convertStage.stop();
+  arucoStage.stop();
+  publishStage.stop();
+  // waiting images are saved before stop
+  imageSaver.stop();
+}
+
+//////////////////////////////////////////////////
+
+UCamConvert::UCamConvert(UCamera * camera)
+  : UVisionStage("convert", 1)
+{
+  cam = camera;
+}
+
+bool UCamConvert::process(UVisionFrame & frame)
+{ // convert only what is needed for this frame
+  if (cam->saveImage or cam->arUcos->debugImages)
+    cam->captureMode = UV4l2::CAPTURE_BGR;
+  else if (cam->doArUcoAnalysis or cam->doArUcoLoopTest)
+    // ArUco detection uses gray only
+    cam->captureMode = UV4l2::CAPTURE_GRAY;
+  else
+    // image is not used
+    cam->captureMode = UV4l2::CAPTURE_HALF_GRAY;
+  frame.mode = cam->captureMode;
+  bool isOK = cam->convertFrame(frame.raw, frame.image);
+  // give buffer back to driver
+  frame.raw.reset();
+  return isOK and frame.image.rows > 10 and frame.image.cols > 10;
+}
+
+//////////////////////////////////////////////////
+
+UCamArUco::UCamArUco(UCamera * camera)
+  : UVisionStage("ArUco", 1)
+{
+  cam = camera;
+}
+
+bool UCamArUco::process(UVisionFrame & frame)
+{
+  if (frame.mode != UV4l2::CAPTURE_BGR and frame.mode != UV4l2::CAPTURE_GRAY)
+    // converted before ArUco was requested, camera matrix is for full resolution only,
+    // so wait for a full resolution frame
+    return true;
+  if (cam->doArUcoAnalysis)
+  { // robot pose at the time the image was captured,
+    // interpolated from pose history, so robot may be moving
+    UPose imPose;
+    bool havePose = cam->bridge->pose->poseAt(frame.imTime, &imPose);
+    // do ArUco detection
+    cam->arUcos->doArUcoProcessing(frame.image, frame.number, frame.imTime, havePose ? &imPose : NULL);
+    cam->doArUcoAnalysis = false;
+    if (havePose)
+      cam->arUcos->setPoseAtImageTime(imPose.x, imPose.y, imPose.h);
+  }
+  if (cam->doArUcoLoopTest and arucoLoop > 0)
+  { // timing test - 100 ArUco analysis on 100 frames
+    UTime t;
+    if (arucoLoop == 100)
+      dt = 0;
+    arucoLoop--;
+    t.now();
+    cam->arUcos->doArUcoProcessing(frame.image, frame.number, frame.imTime);
+    dt += t.getTimePassed();
+    if (arucoLoop == 0)
+    { // finished
+      printf("# average ArUco analysis took %.2f ms\n", dt/100 * 1000);
+      cam->doArUcoLoopTest = false;
+      arucoLoop = 100;
+    }
+  }
+  return true;
+}
+
+//////////////////////////////////////////////////
+
+UCamPublish::UCamPublish(UCamera * camera)
+  : UVisionStage("publish", 1)
+{
+  cam = camera;
+}
+
+bool UCamPublish::process(UVisionFrame & frame)
+{
+  cam->imTime = frame.imTime;
+#ifndef raspicam_CV_LIBS
+  // debug
+  if (frame.number > 0 and frame.number %10 == 0 and cam->arUcos->debugImages)
+  {
+    cam->printStatus();
+    const int MSL = 60;
+    char s[MSL], s2[MSL];
+    snprintf(s, MSL, "saved_image_%s", frame.imTime.getForFilename(s2, true));
+    // saved by encoder threads
+    cam->imageSaver.save(frame.image, s);
+    // debug
+    if (frame.number*3 < 1200)
+      cam->setExposure(frame.number*3);
+    else
+      printf("##### finished exposure range #####\n");
+    // debug end
+  }
+#endif
+  if (cam->logImg != NULL)
+  { // save to image logfile
+    fprintf(cam->logImg, "%ld.%03ld %.3f %d %d %d\n", 
+            frame.imTime.getSec(), frame.imTime.getMilisec(), 
+            cam->bridge->info->regbotTime, frame.number,
+            cam->saveImage, cam->doArUcoAnalysis);
+  }
+  if (cam->saveImage and frame.image.type() == CV_8UC3)
+  { // save image (compressed and saved to flash by the image saver threads)
+    cam->saveImageAsPng(frame.image);
+  }
+  return true;
+}
+
 //////////////////////////////////////////////////
 
 /**
- * Save image as png file
- * \param im is the 8-bit RGB image to save
- * \param filename is an optional image filename, if not used, then image is saved as image_[timestamp].png
+ * Save image in the image saver format (PNG by default),
+ * the image is queued and saved by the image saver threads.
+ * \param im is the 8-bit BGR image to save (must not be modified after this call)
+ * \param filename is an optional image filename, if not used, then image is saved as i1[number]_ucamera_[timestamp].png
  * */
 void UCamera::saveImageAsPng(cv::Mat im, const char * filename)
 {
@@ -445,23 +517,20 @@ void UCamera::saveImageAsPng(cv::Mat im, const char * filename)
     usename = "ucamera";
   }
   imTime.getForFilename(date);
-  // construct filename
-  snprintf(name, MNL, "i1%04d_%s_%s.png", imageNumber, usename, date);
-  // convert to RGB
-  //cv::cvtColor(im, im, cv::COLOR_BGR2RGB);
-  // make PNG option - compression level 6
-  vector<int> compression_params;
-  compression_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
-  compression_params.push_back(6);
-  // save image
-  cv::imwrite(name, im, compression_params);
-  // debug message
-  printf("saved image to: %s\n", name);
-  if (logImg != NULL)
-  { // save to image logfile
-    fprintf(logImg, "%ld.%03ld %.3f %d 0 0 '%s'\n", imTime.getSec(), imTime.getMilisec(), bridge->info->regbotTime, imageNumber, name);
-    fflush(logImg);
+  // construct filename (extension is added by image saver)
+  snprintf(name, MNL, "i1%04d_%s_%s", imageNumber, usename, date);
+  std::string fullname;
+  if (imageSaver.save(im, name, &fullname))
+  { // debug message
+    printf("saving image to: %s\n", fullname.c_str());
+    if (logImg != NULL)
+    { // save to image logfile
+      fprintf(logImg, "%ld.%03ld %.3f %d 0 0 '%s'\n", imTime.getSec(), imTime.getMilisec(), bridge->info->regbotTime, imageNumber, fullname.c_str());
+      fflush(logImg);
+    }
   }
+  else
+    printf("# image %s dropped (save queue full)\n", fullname.c_str());
 }
 
 
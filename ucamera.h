@@ -43,10 +43,54 @@
 
 #include "ucamera_v4l2.h"
 #include "utime.h"
+#include "upipeline.h"
+#include "uimagesaver.h"
 
 
 using namespace std;
 
+class UCamera;
+
+/**
+ * Convert stage - converts the raw frame to an image in the format
+ * needed by the ArUco and publish stages, and gives the driver buffer back */
+class UCamConvert : public UVisionStage
+{
+public:
+  UCamConvert(UCamera * camera);
+protected:
+  bool process(UVisionFrame & frame) override;
+private:
+  UCamera * cam;
+};
+
+/**
+ * ArUco stage - marker detection on request (doArUcoAnalysis) and loop test */
+class UCamArUco : public UVisionStage
+{
+public:
+  UCamArUco(UCamera * camera);
+protected:
+  bool process(UVisionFrame & frame) override;
+private:
+  UCamera * cam;
+  /// loop test count and time
+  int arucoLoop = 100;
+  float dt = 0;
+};
+
+/**
+ * Publish stage - image log, save image on request and debug images */
+class UCamPublish : public UVisionStage
+{
+public:
+  UCamPublish(UCamera * camera);
+protected:
+  bool process(UVisionFrame & frame) override;
+private:
+  UCamera * cam;
+};
+
 /**
  * The camera class has the functions
  * to open, close, configure and
@@ -67,6 +111,21 @@ public:
   cv::Vec3d camPos = {0.03, 0.03, 0.27}; /// x=fwd, y=left, z=up
   cv::Vec3d camRot = {0, 10*M_PI/180.0, 0}; /// roll, tilt, yaw (right hand rule, radians)
   cv::Mat cam2robot;
+  /**
+   * Vision pipeline, the camera thread captures frames,
+   * frames are then converted, and passed to the ArUco
+   * and the publish stage, each stage has its own thread.
+   * A stage that is busy gets the newest frame only (older frames are dropped).
+   * Ball, tree, trunk and apple detection is done by CVPositions (own camera) */
+  UCamConvert convertStage;
+  UCamArUco arucoStage;
+  UCamPublish publishStage;
+  /**
+   * Saved images are compressed and written by background threads,
+   * format (PNG, JPEG or raw) is selected in the image saver */
+  UImageSaver imageSaver;
+  /// number of image saver threads (started with the pipeline)
+  int imageSaverThreads = 2;
   //
   /** camera matrix is a 3x3 matrix (raspberry PI typical values)
    *    pix    ---1----  ---2---  ---3---   -3D-
@@ -123,10 +182,15 @@ public:
   void setPos(float x, float y, float z);
   
 private:
+  friend class UCamConvert;
+  friend class UCamArUco;
+  friend class UCamPublish;
   // pointer to regbot interface
   UBridge * bridge;
   // image saved number
   int imageNumber = 0;
+  /// number of failed frame captures
+  int captureFailCnt = 0;
   // time image was taken
   UTime imTime, im2Time;
   // logfile for images
@@ -136,7 +200,7 @@ private:
 
 public:
   /**
-   * Save image to flashdisk */
+   * Save image to flashdisk (queued for the image saver threads) */
   void saveImageAsPng(cv::Mat im, const char * filename = NULL);
   
 protected:
@@ -168,6 +232,10 @@ protected:
   /**
    * Configure camera */
   bool setupCamera();
+  /**
+   * start and stop the threads of the vision pipeline stages */
+  void startPipeline();
+  void stopPipeline();
 
 public:
   /**
@@ -187,7 +255,7 @@ public:
 //   bool logArucoIsOpen()
 //   { return logArUco != NULL; }
   /**
-   * method to do the image analysis - see ucamera.cpp */
+   * Camera thread - captures frames for the vision pipeline - see ucamera.cpp */
   void run();
 };
 
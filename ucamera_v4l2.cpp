@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <sys/ioctl.h>
 #include <opencv2/opencv.hpp>
@@ -31,6 +32,8 @@
 #include <linux/videodev2.h>
 
 #include "ucamera_v4l2.h"
+#include "ubayer.h"
+#include "urun.h"
 #include "utime.h"
 
 #define CLEAR(x) memset(&(x), 0, sizeof(x))
@@ -76,36 +79,42 @@ void UV4l2::process_image(void *p, int size, cv::Mat & imRGB)
     fclose(fp);
   }
   cv::Size sz(w,h);
+  // part of image to convert
+  cv::Rect roi = getCaptureRoi();
   // destination image
   //imRGB = cv::Mat::zeros(cv::Size(1, 49), CV_64FC1);
   // convert to RGB
   if (pixelFormat == V4L2_PIX_FMT_YUYV)
   {
-    cv::Mat imYUY2(sz,CV_8UC2, (void*)p);  
-    cv::cvtColor(imYUY2, imRGB, cv::COLOR_YUV2BGR_YUYV);
+    cv::Mat imYUY2(sz,CV_8UC2, (void*)p, maxi(bytesPerLine, w * 2));
+    cv::Mat im;
+    cv::cvtColor(imYUY2(roi), im, cv::COLOR_YUV2BGR_YUYV);
+    applyCaptureMode(im, imRGB);
   }
   else if (pixelFormat == V4L2_PIX_FMT_RGB24)
   {
-    cv::Mat im(sz,CV_8UC3, (void*)p);
-    imRGB = im.clone();
+    cv::Mat im(sz,CV_8UC3, (void*)p, maxi(bytesPerLine, w * 3));
+    if (captureMode == CAPTURE_BGR)
+      imRGB = im(roi).clone();
+    else
+      applyCaptureMode(im(roi), imRGB);
     printf("# Image %d\n", frame_number);
   }
   else if (pixelFormat == V4L2_PIX_FMT_SBGGR10)
   { // 10 bit Bayer unpacked (BG10)
     // printf("# unpacking V4L2_PIX_FMT_SBGGR10 (10 bit Bayer 'BG10')\n");
-    uint8_t * ba8a = (uint8_t *)malloc(size/2);
-    uint16_t * ba10a = (uint16_t *)p;
-    uint8_t * ba8 = ba8a;
-    uint16_t * b1 = ba10a;
     struct timespec tns1;
     struct timespec tns2;
     clock_gettime(CLOCK_REALTIME, & tns1);
-    for (int i = 0; i < size/(2*4); i++)
-    { // unfolding by 4 pixels in a row (saves a bit of time)
-      *ba8++ = *b1++ >> 2; // remove 2 LSB
-      *ba8++ = *b1++ >> 2;
-      *ba8++ = *b1++ >> 2;
-      *ba8++ = *b1++ >> 2;
+    // buffer is allocated for first frame only (or when ROI size changes)
+    bayer8.create(roi.size(), CV_8UC1);
+    int srcStep = maxi(bytesPerLine, w * 2);
+    if (srcStep == w * 2 and roi.width == w)
+      bayer10to8((uint16_t *)p + roi.y * w, bayer8.data, roi.area());
+    else
+    { // lines are padded or only part of line is needed
+      for (int r = 0; r < roi.height; r++)
+        bayer10to8((uint16_t *)((uint8_t *)p + (roi.y + r) * srcStep) + roi.x, bayer8.ptr(r), roi.width);
     }
     clock_gettime(CLOCK_REALTIME, & tns2);
     if (false)
@@ -116,8 +125,7 @@ void UV4l2::process_image(void *p, int size, cv::Mat & imRGB)
     }
     //
     clock_gettime(CLOCK_REALTIME, & tns1);
-    cv::Mat im(sz,CV_8UC1, (void*)ba8a);  
-    cv::demosaicing(im, imRGB, cv::COLOR_BayerRG2BGR, 3);
+    convertBayer(bayer8, imRGB);
     clock_gettime(CLOCK_REALTIME, & tns2);
     if (false)
     { // print conversion time
@@ -125,90 +133,28 @@ void UV4l2::process_image(void *p, int size, cv::Mat & imRGB)
       double dt = (tns2.tv_sec - tns1.tv_sec) * 1e6 +  (tns2.tv_nsec - tns1.tv_nsec)*1e-3;
       printf("# DeBayer took          %g us\n", dt);
     }
-    free(ba8a);
   }
   else if(pixelFormat == V4L2_PIX_FMT_SBGGR8)
-  { // 8-bit Bayer (BA81)
-    printf("# unpacking V4L2_PIX_FMT_SBGGR8 (8 bit Bayer BA81) - not working with new camera\n");
-    cv::Mat im(sz,CV_8UC1, (void*)p);  
-    cv::demosaicing(im, imRGB, cv::COLOR_BayerRG2BGR, 3);
+  { // 8-bit Bayer (BA81) - not tested with new camera
+    cv::Mat im(sz,CV_8UC1, (void*)p, maxi(bytesPerLine, w));
+    convertBayer(im(roi), imRGB);
   }
   else if (pixelFormat == V4L2_PIX_FMT_SBGGR10P)
-  { // 10 bit packed Bayer (pBAA)
-    printf("# unpacking V4L2_PIX_FMT_SBGGR10P (10 bit packed Bayer 'pBAA') -- not working with new camera\n");
-    uint8_t * ba8a = (uint8_t *)malloc(size/2);
-    uint16_t * ba10a = (uint16_t *)p;
-    uint8_t * ba8 = ba8a;
-    uint16_t * b1 = ba10a;
-    uint16_t * b2 = ba10a + 1;
-    const int n = w*h;
-    int b = 0;
-    unsigned int v = 0;
-    for (int i = 0; i < n; i++)
-    { // convert from 10 bit to 8 bit
-      switch (b)
-      {
-        case 0:
-          v = *b1 >> 6;
-          *ba8 = v >> 2;
-          break;
-        case 1:
-          v = (*b1 << 4) + (*b2 >> 12);
-          *ba8 = v >> 2;
-          break;
-        case 2:
-          b1++;
-          b2++;
-          v = *b1 >> 2;
-          *ba8 = v >> 2;
-          break;
-        case 3:
-          v = (*b1 << 8) + (*b2 >> 8);
-          *ba8 = v >> 2;
-          break;
-        case 4:
-          b1++;
-          b2++;
-          v = (*b1 << 2) + (*b2 >> 14);
-          *ba8 = v >> 2;
-          break;
-        case 5:
-          v = (*b2 >> 4);
-          *ba8 = v >> 2;
-          break;
-        case 6:
-          b1++;
-          b2++;
-          v = (*b1 << 6) + (*b2 >> 10);
-          *ba8 = v >> 2;
-          break;
-        case 7:
-          b1++;
-          b2++;
-          v = *b1;
-          *ba8 = v >> 2;
-          break;
-      }
-      if (i < 50)
-      {
-        printf("# pixel %d, set %d, b1=%x, b2=%x is %x -> %x\n", i, b, *b1, *b2, v, *ba8);
-      }
-      ba8++;
-      b++;
-      if (b > 7)
-      {
-        b = 0;
-        b1++;
-        b2++;
-      }
+  { // 10 bit packed Bayer (pBAA), 4 pixels in 5 bytes,
+    // the first 4 bytes are the 8 MSB of the 4 pixels
+    bayer8.create(roi.size(), CV_8UC1);
+    int srcStep = maxi(bytesPerLine, w * 5 / 4);
+    if (srcStep == w * 5 / 4 and roi.width == w)
+      bayer10Pto8((uint8_t *)p + roi.y * srcStep, bayer8.data, roi.area());
+    else
+    { // lines are padded or only part of line is needed (roi.x is a multiple of 4)
+      for (int r = 0; r < roi.height; r++)
+        bayer10Pto8((uint8_t *)p + (roi.y + r) * srcStep + roi.x * 5 / 4, bayer8.ptr(r), roi.width);
     }
     // now we have 1 byte per pixel Bayer-coded 
     //  0   BGBGBGBG ...
     //  1   GRGRGRGR ...
-//     cv::Size pxs(w,h);
-    cv::Mat src(sz, CV_8UC1, (void*)ba8a);
-    cv::demosaicing(src, imRGB, cv::COLOR_BayerRG2BGR,3);
-    free(ba8a);
+    convertBayer(bayer8, imRGB);
   }
   if (false)
   { // if robot has screen (or connected with -X)
@@ -233,6 +179,78 @@ void UV4l2::process_image(void *p, int size, cv::Mat & imRGB)
   }
 }
 
+cv::Rect UV4l2::getCaptureRoi()
+{
+  cv::Rect roi(0, 0, w, h);
+  if (captureRoi.area() > 0)
+  { // keep Bayer pattern and packed pixel groups, 
+    // i.e. x and width a multiple of 4, y and height even
+    int x1 = maxi(0, captureRoi.x) & ~3;
+    int y1 = maxi(0, captureRoi.y) & ~1;
+    int x2 = (mini(w, captureRoi.x + captureRoi.width) + 3) & ~3;
+    int y2 = (mini(h, captureRoi.y + captureRoi.height) + 1) & ~1;
+    if (x2 > w)
+      x2 -= 4;
+    if (y2 > h)
+      y2 -= 2;
+    if (x2 > x1 and y2 > y1)
+      roi = cv::Rect(x1, y1, x2 - x1, y2 - y1);
+  }
+  return roi;
+}
+
+void UV4l2::convertBayer(const cv::Mat & bayer, cv::Mat & image)
+{ // NB! the OpenCV Bayer names are shifted one pixel, 
+  // so BayerRG is BGGR in V4L2 naming
+  switch (captureMode)
+  {
+    case CAPTURE_GRAY:
+      cv::cvtColor(bayer, image, cv::COLOR_BayerRG2GRAY);
+      break;
+    case CAPTURE_HALF_BGR:
+      image.create(bayer.rows / 2, bayer.cols / 2, CV_8UC3);
+      bayer8HalfBGR(bayer.data, bayer.step, image.data, image.step, image.cols, image.rows);
+      break;
+    case CAPTURE_HALF_GRAY:
+      image.create(bayer.rows / 2, bayer.cols / 2, CV_8UC1);
+      bayer8HalfGray(bayer.data, bayer.step, image.data, image.step, image.cols, image.rows);
+      break;
+    default:
+      cv::demosaicing(bayer, image, cv::COLOR_BayerRG2BGR, 3);
+      break;
+  }
+}
+
+void UV4l2::applyCaptureMode(const cv::Mat & bgr, cv::Mat & image)
+{ // for formats that are not Bayer coded
+  switch (captureMode)
+  {
+    case CAPTURE_GRAY:
+      cv::cvtColor(bgr, image, cv::COLOR_BGR2GRAY);
+      break;
+    case CAPTURE_HALF_BGR:
+      cv::resize(bgr, image, cv::Size(bgr.cols / 2, bgr.rows / 2), 0, 0, cv::INTER_AREA);
+      break;
+    case CAPTURE_HALF_GRAY:
+    {
+      cv::Mat gray;
+      cv::cvtColor(bgr, gray, cv::COLOR_BGR2GRAY);
+      cv::resize(gray, image, cv::Size(bgr.cols / 2, bgr.rows / 2), 0, 0, cv::INTER_AREA);
+      break;
+    }
+    default:
+      image = bgr;
+      break;
+  }
+}
+
+bool UV4l2::grab(cv::Mat & image, CaptureMode mode, cv::Rect roi)
+{
+  captureMode = mode;
+  captureRoi = roi;
+  return grab(image);
+}
+
 const int UV4l2::read_frame(cv::Mat & image)
 {
   struct v4l2_buffer buf;
@@ -326,14 +344,11 @@ const int UV4l2::read_frame(cv::Mat & image)
 }
 
 
-bool UV4l2::grab(cv::Mat & image)
-{ // wait for data is ready (up to 2 seconds)
-  // then read frame and convert to RGB 
-  bool isOK = false;
+bool UV4l2::waitForFrame()
+{
   for (;;) {
     fd_set fds;
     struct timeval tv;
-    int r;
     // set device to check
     FD_ZERO(&fds);
     FD_SET(fd, &fds);
@@ -341,25 +356,103 @@ bool UV4l2::grab(cv::Mat & image)
     tv.tv_sec = 2;
     tv.tv_usec = 0;
     // wait for data available
-    r = select(fd + 1, &fds, NULL, NULL, &tv);
+    int r = select(fd + 1, &fds, NULL, NULL, &tv);
     // test for signal - retry to get image
     if (-1 == r) {
       if (EINTR == errno)
         continue;
       errno_exit("select");
     }
-    // is camera still there (other error)
     if (0 == r) {
       fprintf(stderr, "select timeout\n");
-      exit(EXIT_FAILURE);
+      return false;
     }
-    // read and process data
-    tImg.now();
-    isOK = read_frame(image);
-    break;
-    /* EAGAIN - continue select loop. */
+    return true;
+  }
+}
+
+UFrameLease UV4l2::leaseFrame()
+{
+  if (io != IO_METHOD_MMAP or not cameraOpen)
+    return UFrameLease();
+  if (leaseCnt >= (int)n_buffers - 1)
+  { // driver needs at least one buffer
+    leaseFailCnt++;
+    return UFrameLease();
+  }
+  if (not waitForFrame())
+    return UFrameLease();
+  tImg.now();
+  struct v4l2_buffer buf;
+  CLEAR(buf);
+  buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+  buf.memory = V4L2_MEMORY_MMAP;
+  if (-1 == xioctl(fd, VIDIOC_DQBUF, &buf)) {
+    if (errno == EAGAIN)
+      return UFrameLease();
+    errno_exit("VIDIOC_DQBUF");
   }
-  return isOK;
+  UV4l2Frame * f = new UV4l2Frame();
+  f->data = buffers[buf.index].start;
+  f->bytesUsed = buf.bytesused;
+  f->w = w;
+  f->h = h;
+  f->bytesPerLine = bytesPerLine;
+  f->pixelFormat = pixelFormat;
+  f->time = tImg;
+  if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+  { // driver timestamp (monotonic clock) is the capture time,
+    // so capture time is the time since then before now
+    timespec mono;
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    float age = (mono.tv_sec - buf.timestamp.tv_sec) + (mono.tv_nsec / 1000 - buf.timestamp.tv_usec) * 1e-6;
+    if (age >= 0 and age < 1.0)
+      f->time = tImg - age;
+  }
+  f->frameNumber = ++frame_number;
+  f->index = buf.index;
+  f->generation = streamGeneration;
+  leaseCnt++;
+  return UFrameLease(f, [this](const UV4l2Frame * frame) { releaseFrame((UV4l2Frame *)frame); });
+}
+
+void UV4l2::releaseFrame(UV4l2Frame * frame)
+{ // stop_capturing() can not change generation while requeued
+  std::lock_guard<std::mutex> lock(leaseMtx);
+  if (frame->generation == streamGeneration and cameraOpen)
+  { // still streaming - give buffer back to driver
+    struct v4l2_buffer buf;
+    CLEAR(buf);
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = frame->index;
+    if (-1 == xioctl(fd, VIDIOC_QBUF, &buf))
+      perror("UV4l2::releaseFrame VIDIOC_QBUF");
+  }
+  leaseCnt--;
+  delete frame;
+  leaseReleased.notify_all();
+}
+
+bool UV4l2::convertFrame(const UFrameLease & frame, cv::Mat & image)
+{
+  if (not frame)
+    return false;
+  // process_image counts frames too
+  frame_number = frame->frameNumber - 1;
+  process_image(frame->data, frame->bytesUsed, image);
+  return true;
+}
+
+bool UV4l2::grab(cv::Mat & image)
+{ // wait for data is ready (up to 2 seconds)
+  // then read frame and convert to RGB 
+  if (not waitForFrame())
+    // is camera still there (other error)
+    exit(EXIT_FAILURE);
+  // read and process data
+  tImg.now();
+  return read_frame(image);
 }
 
 const void UV4l2::mainloop(void)
@@ -407,6 +500,10 @@ const void UV4l2::mainloop(void)
 const void UV4l2::stop_capturing(void)
 {
   enum v4l2_buf_type type;
+  // leased buffers are not to be queued after this,
+  // the lock ensures no lease release is queueing while streaming stops
+  std::lock_guard<std::mutex> lock(leaseMtx);
+  streamGeneration++;
   
   switch (io) {
     case IO_METHOD_READ:
@@ -492,6 +589,12 @@ const void UV4l2::uninit_device(void)
       break;
       
     case IO_METHOD_MMAP:
+      if (leaseCnt > 0)
+      { // the buffers must stay mapped until all consumers are finished
+        printf("# UV4l2:: waiting for %d leased frames to be released\n", leaseCnt.load());
+        std::unique_lock<std::mutex> lock(leaseMtx);
+        leaseReleased.wait(lock, [this]{ return leaseCnt == 0; });
+      }
       for (i = 0; i < n_buffers; ++i)
       {
         if (-1 == munmap(buffers[i].start, buffers[i].length))
@@ -506,6 +609,8 @@ const void UV4l2::uninit_device(void)
   }
   
   free(buffers);
+  // unpack buffer is for this stream only
+  bayer8.release();
 }
 
 const void UV4l2::init_read(unsigned int buffer_size)
@@ -532,7 +637,7 @@ const void UV4l2::init_mmap(void)
   
   CLEAR(req);
   
-  req.count = 4;
+  req.count = maxi(2, bufferCount);
   req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   req.memory = V4L2_MEMORY_MMAP;
   
@@ -582,6 +687,7 @@ const void UV4l2::init_mmap(void)
     if (MAP_FAILED == buffers[n_buffers].start)
       errno_exit("mmap");
   }
+  bufferCount = n_buffers;
 }
 
 const void UV4l2::init_userp(unsigned int buffer_size)
@@ -738,7 +844,8 @@ const void UV4l2::init_device(void)
   }
   
   if (cameraOpen)
-  {
+  { // line length as used by driver (before paranoia)
+    bytesPerLine = fmt.fmt.pix.bytesperline;
     /* Buggy driver paranoia. */
     min = fmt.fmt.pix.width * 2;
     if (fmt.fmt.pix.bytesperline < min)
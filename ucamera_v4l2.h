@@ -33,6 +33,10 @@
 
 #include <linux/videodev2.h>
 #include <opencv2/opencv.hpp>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "utime.h"
 // 
@@ -41,10 +45,71 @@
 // #endif
 
 
+/**
+ * A raw frame in a driver (mmap) buffer, see UV4l2::leaseFrame() */
+class UV4l2Frame
+{
+public:
+  /// raw image data (in driver buffer)
+  void * data;
+  /// bytes of valid data
+  int bytesUsed;
+  /// image size and line length (bytes)
+  int w, h, bytesPerLine;
+  /// V4L2 pixel format, e.g. V4L2_PIX_FMT_SBGGR10
+  unsigned int pixelFormat;
+  /// capture time (from driver timestamp, if the driver has a monotonic timestamp, else time received)
+  UTime time;
+  int frameNumber;
+  /**
+   * OpenCV header for the raw data (no copy), valid while the lease is held.
+   * \param type is the OpenCV type for one pixel, e.g. CV_16UC1 for SBGGR10 or CV_8UC2 for YUYV */
+  cv::Mat raw(int type) const
+  {
+    return cv::Mat(h, w, type, data, bytesPerLine);
+  }
+private:
+  friend class UV4l2;
+  /// driver buffer index
+  unsigned int index;
+  /// stream this buffer belongs to
+  int generation;
+};
+/**
+ * A frame lease holds a driver buffer, the buffer is given back
+ * to the driver (VIDIOC_QBUF) when the last copy of the lease is released.
+ * All leases must be released before the camera is closed (uninit_device() waits for that),
+ * and the UV4l2 object must outlive its leases. */
+typedef std::shared_ptr<const UV4l2Frame> UFrameLease;
+
+
 class UV4l2
 {
 public:
   bool cameraOpen = false;
+  /**
+   * Image format made by grab(), the half resolution formats are
+   * made directly from the Bayer coded pixels (no demosaicing) */
+  enum CaptureMode {
+    CAPTURE_BGR,       ///< full resolution colour (demosaiced)
+    CAPTURE_GRAY,      ///< full resolution gray
+    CAPTURE_HALF_BGR,  ///< half resolution colour, one pixel for each 2x2 Bayer quad
+    CAPTURE_HALF_GRAY  ///< half resolution luma, one pixel for each 2x2 Bayer quad
+  };
+  /// format for next grab
+  CaptureMode captureMode = CAPTURE_BGR;
+  /// number of driver buffers requested (set before camera is opened),
+  /// when open, this is the number of buffers given by the driver
+  int bufferCount = 4;
+  /**
+   * Part of image to convert (full image coordinates), 
+   * an empty rectangle is full image.
+   * The used ROI has x and width a multiple of 4 and y and height even (see getCaptureRoi()) */
+  cv::Rect captureRoi;
+  /**
+   * Get the part of the image that is converted in full image coordinates,
+   * a half resolution image has half this size */
+  cv::Rect getCaptureRoi();
 protected:
   enum io_method {
     IO_METHOD_READ,
@@ -59,10 +124,16 @@ protected:
   
   int w = 0,h = 0;
   int step = 0;
+  /// bytes per line in raw image from driver
+  int bytesPerLine = 0;
   unsigned int pixelFormat = 0;
   // resulting image
 //   cv::Mat imRGB;
   UTime tImg;
+  /// number of frames leased now
+  std::atomic<int> leaseCnt = {0};
+  /// number of times no frame could be leased (all buffers leased)
+  int leaseFailCnt = 0;
 
 private:
 
@@ -75,14 +146,31 @@ private:
   struct buffer   *buffers;
   unsigned int     n_buffers;
   int              out_buf = 0;
+  /// changed when streaming stops, old leases are then not requeued
+  std::atomic<int> streamGeneration = {0};
+  /// lock for lease release against stop of streaming
+  std::mutex leaseMtx;
+  /// signalled when a lease is released
+  std::condition_variable leaseReleased;
+  /** give buffer back to driver (called when last lease is released) */
+  void releaseFrame(UV4l2Frame * frame);
+  /** wait for a frame to be ready
+   * \returns false on timeout */
+  bool waitForFrame();
+  /// 8-bit Bayer image (from 10-bit formats), allocated once per stream
+  cv::Mat bayer8;
 
   struct v4l2_queryctrl queryctrl;
   struct v4l2_querymenu querymenu;
   
 protected:
 
-  /** convert to cv::Mat image */
+  /** convert to cv::Mat image (in captureMode format) */
   virtual void process_image(void *p, int size, cv::Mat & imRGB);
+  /** convert 8-bit Bayer image to captureMode format */
+  void convertBayer(const cv::Mat & bayer, cv::Mat & image);
+  /** convert a BGR image to captureMode format */
+  void applyCaptureMode(const cv::Mat & bgr, cv::Mat & image);
   /**
   * Close file handle */
   const void close_device(void);
@@ -103,12 +191,32 @@ protected:
   * Start capturing - tell camera to start streaming in desired format */
   const void start_capturing(void);
   /**
-  * device setting cleanup */
+  * device setting cleanup,
+  * waits until all frame leases are released (so the buffers can be unmapped) */
   const void uninit_device(void);
   /**
    * Capture and convert image to RGB.
    * \returns the image or generate an error */
   bool grab(cv::Mat & image);
+  /**
+   * Capture and convert image to the requested format and region of interest.
+   * \param mode is the image format wanted
+   * \param roi is the part of the image wanted (empty is full image)
+   * \returns true if an image is captured */
+  bool grab(cv::Mat & image, CaptureMode mode, cv::Rect roi = cv::Rect());
+  /**
+   * Wait for the next frame and lease its driver buffer - no copy or conversion.
+   * The buffer is not reused by the driver until the lease is released,
+   * one buffer is always left to the driver, so if all other buffers are leased,
+   * no frame is returned.
+   * Memory mapped IO only.
+   * \returns the lease or an empty lease if no frame */
+  UFrameLease leaseFrame();
+  /**
+   * Convert a leased frame to an image in captureMode format
+   * (from the same thread as grab()).
+   * \returns true if converted */
+  bool convertFrame(const UFrameLease & frame, cv::Mat & image);
   /**
    * list video capability */
   void listCapability();
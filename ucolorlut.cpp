@@ -0,0 +1,145 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <opencv2/imgproc.hpp>
+#include "ucolorlut.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+
+void UColorLut::setClass(int cls, const int lower[3], const int upper[3])
+{
+  if (cls < 0 or cls >= MAX_CLASSES)
+    return;
+  boxes[cls].used = true;
+  for (int i = 0; i < 3; i++)
+  {
+    boxes[cls].lower[i] = lower[i];
+    boxes[cls].upper[i] = upper[i];
+  }
+  changed = true;
+}
+
+void UColorLut::clearClass(int cls)
+{
+  if (cls < 0 or cls >= MAX_CLASSES)
+    return;
+  boxes[cls].used = false;
+  changed = true;
+}
+
+void UColorLut::build()
+{ // HSV of the centre of all colour cells, converted by OpenCV, 
+  // so that the hue scale is the same as for cvtColor
+  const int N = 1 << 15;
+  cv::Mat bgr(1, N, CV_8UC3);
+  cv::Mat hsv;
+  uint8_t * p = bgr.ptr<uint8_t>(0);
+  for (int i = 0; i < N; i++)
+  {
+    *p++ = ((i >> 10) << 3) | 4;
+    *p++ = (((i >> 5) & 0x1f) << 3) | 4;
+    *p++ = ((i & 0x1f) << 3) | 4;
+  }
+  cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+  lut.resize(N);
+  const uint8_t * q = hsv.ptr<uint8_t>(0);
+  for (int i = 0; i < N; i++)
+  {
+    uint8_t label = 0;
+    for (int c = 0; c < MAX_CLASSES; c++)
+    {
+      const Box & b = boxes[c];
+      if (not b.used)
+        continue;
+      bool inH;
+      if (b.lower[0] <= b.upper[0])
+        inH = q[0] >= b.lower[0] and q[0] <= b.upper[0];
+      else
+        // wraps around 0
+        inH = q[0] >= b.lower[0] or q[0] <= b.upper[0];
+      if (inH and q[1] >= b.lower[1] and q[1] <= b.upper[1] and 
+                  q[2] >= b.lower[2] and q[2] <= b.upper[2])
+        label |= 1 << c;
+    }
+    lut[i] = label;
+    q += 3;
+  }
+  changed = false;
+}
+
+/**
+ * Label one row of BGR pixels */
+static void classifyRow(const uint8_t * src, uint8_t * dst, int n, const uint8_t * lut)
+{
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  uint16_t idx[16];
+  for (; i <= n - 16; i += 16)
+  { // table index for 16 pixels at a time
+    uint8x16x3_t px = vld3q_u8(src + i * 3);
+    uint8x16_t b = vshrq_n_u8(px.val[0], 3);
+    uint8x16_t g = vshrq_n_u8(px.val[1], 3);
+    uint8x16_t r = vshrq_n_u8(px.val[2], 3);
+    uint16x8_t lo = vorrq_u16(vshlq_n_u16(vmovl_u8(vget_low_u8(b)), 10),
+                    vorrq_u16(vshlq_n_u16(vmovl_u8(vget_low_u8(g)), 5), vmovl_u8(vget_low_u8(r))));
+    uint16x8_t hi = vorrq_u16(vshlq_n_u16(vmovl_u8(vget_high_u8(b)), 10),
+                    vorrq_u16(vshlq_n_u16(vmovl_u8(vget_high_u8(g)), 5), vmovl_u8(vget_high_u8(r))));
+    vst1q_u16(idx, lo);
+    vst1q_u16(idx + 8, hi);
+    // no gather instruction, so table lookup is one at a time
+    for (int k = 0; k < 16; k++)
+      dst[i + k] = lut[idx[k]];
+  }
+#endif
+  // the rest (or all without NEON)
+  src += i * 3;
+  for (; i < n; i++)
+  {
+    dst[i] = lut[((src[0] >> 3) << 10) | ((src[1] >> 3) << 5) | (src[2] >> 3)];
+    src += 3;
+  }
+}
+
+void UColorLut::classify(const cv::Mat & bgr, cv::Mat & labels)
+{
+  if (changed)
+    build();
+  labels.create(bgr.rows, bgr.cols, CV_8UC1);
+  for (int r = 0; r < bgr.rows; r++)
+    classifyRow(bgr.ptr<uint8_t>(r), labels.ptr<uint8_t>(r), bgr.cols, lut.data());
+}
+
+void UColorLut::classMask(const cv::Mat & labels, int cls, cv::Mat & mask)
+{
+  const uint8_t bit = 1 << cls;
+  mask.create(labels.rows, labels.cols, CV_8UC1);
+  for (int r = 0; r < labels.rows; r++)
+  {
+    const uint8_t * s = labels.ptr<uint8_t>(r);
+    uint8_t * d = mask.ptr<uint8_t>(r);
+    for (int c = 0; c < labels.cols; c++)
+      // 255 if bit is set (vectorized by the compiler)
+      d[c] = -((s[c] & bit) != 0);
+  }
+}
@@ -0,0 +1,80 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UCOLORLUT_H
+#define UCOLORLUT_H
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Colour classification of BGR pixels in HSV boxes in one pass,
+ * replaces cvtColor(BGR2HSV) and one inRange for each colour.
+ * Each pixel is looked up in a 32K entry table (5 bits for each of B, G and R),
+ * the table holds a bit for each colour class, so up to 8 colour classes
+ * are tested at once, and the result is one label image.
+ * The table is made from the HSV of the centre of each 8x8x8 colour cell,
+ * so pixels close to the box limits may be classified differently than inRange would. */
+class UColorLut
+{
+public:
+  /// max number of colour classes (bits in label)
+  static const int MAX_CLASSES = 8;
+  /**
+   * Set HSV limits for a colour class (OpenCV 8-bit HSV, H is 0..179, S and V are 0..255),
+   * limits are inclusive (as inRange), if lower hue is above upper hue the hue range
+   * wraps around 0 (e.g. red from 170 to 10).
+   * \param cls is class number 0..7 (bit number in label)
+   * \param lower is lower H, S, V limit
+   * \param upper is upper H, S, V limit */
+  void setClass(int cls, const int lower[3], const int upper[3]);
+  /**
+   * Remove a colour class */
+  void clearClass(int cls);
+  /**
+   * Classify all pixels
+   * \param bgr is an 8-bit BGR image
+   * \param labels is set to an 8-bit image of same size, bit n is set if pixel is in class n */
+  void classify(const cv::Mat & bgr, cv::Mat & labels);
+  /**
+   * Mask of one colour class
+   * \param labels is label image from classify()
+   * \param cls is class number
+   * \param mask is set to 255 for pixels in class, 0 for others (as from inRange) */
+  static void classMask(const cv::Mat & labels, int cls, cv::Mat & mask);
+private:
+  /** make table from class limits */
+  void build();
+  struct Box
+  {
+    bool used;
+    int lower[3];
+    int upper[3];
+  };
+  Box boxes[MAX_CLASSES] = {};
+  /// label for each 15-bit colour (b << 10 | g << 5 | r)
+  std::vector<uint8_t> lut;
+  /// table must be made again
+  bool changed = true;
+};
+
+#endif
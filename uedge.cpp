@@ -23,6 +23,7 @@
 UEdge::UEdge(UBridge * bridge_ptr, bool openLog)
 {
   bridge = bridge_ptr;
+  bridge->registerMessage("lip", this, [](UData * item, char * msg) { ((UEdge*)item)->decode(msg); });
 }
 
 
@@ -49,6 +50,9 @@ void UEdge::decode(char * msg)
     edgeCrossingBlack = strtol(p1, &p1, 0);
     edgeCrossingWhite = strtol(p1, &p1, 0);
     updated();
+    if (telemetry.isOpen())
+      telemetry.add(URecorder::REC_EDGE, dataTime, 
+                    URecorder::RecEdge{edgeValidLeft, edgeValidRight, edgeCrossingBlack, edgeCrossingWhite});
   }  
 }
 
@@ -24,6 +24,7 @@ UEvent::UEvent(UBridge * bridge_ptr, bool openlog)
 {
   clearEvents();
   bridge = bridge_ptr;
+  bridge->registerMessage("event", this, [](UData * item, char * msg) { ((UEvent*)item)->decode(msg); });
   if (openlog)
     openLog();
 }
@@ -79,9 +80,11 @@ void UEvent::decode(char * msg)
       default: printf("# %.3f got event %d: '%s'\n", dt, eventNumber, msg); break;
     }
   }
+  if (telemetry.isOpen())
+    telemetry.add(URecorder::REC_EVENT, dataTime, URecorder::RecEvent{eventNumber, -1});
   if (logfile != NULL)
   {
-    fprintf(logfile, "%ld.%03ld %2d -1\n", dataTime.tv_sec, dataTime.tv_usec / 1000, eventNumber);
+    logWriter.print(logfile, "%ld.%03ld %2d -1\n", dataTime.tv_sec, dataTime.tv_usec / 1000, eventNumber);
   }
 }
 /** set event flag */
@@ -91,17 +94,21 @@ void UEvent::setEvent(int eventNumber)
   { // event 33 is start button, event 0 is misson stop
     eventUpdate.lock();
     //printf("# Event received: %d\n", eventNumber);
-    eventFlags[eventNumber] = true;
+    gettimeofday(&eventTime[eventNumber], NULL);
+    eventFlags.fetch_or(uint64_t(1) << eventNumber);
     eventUpdate.unlock();
+    // wake any thread waiting for an event
+    eventSignal.notify_all();
   }
 }
 /**
  * print all event flags to console */
 void UEvent::printEvents()
 {
+  uint64_t flags = eventFlags.load();
   for (int i = 0; i < MAX_EVENT_FLAGS; i++)
   {
-    if (eventFlags[i])
+    if (flags & (uint64_t(1) << i))
       printf("#UEvent::print: event %2d is set\n", i);
   }
 }
@@ -109,8 +116,43 @@ void UEvent::printEvents()
  * Clear all event flags to false */
 void UEvent::clearEvents()
 {
-  for (int i = 0; i < MAX_EVENT_FLAGS; i++)
-    eventFlags[i] = false;
+  eventFlags.store(0);
+}
+/**
+ * Reset the lowest set event in mask.
+ * \returns the event number or -1 if none of the events were set */
+int UEvent::takeEvent(uint64_t mask)
+{
+  uint64_t flags = eventFlags.load();
+  while ((flags & mask) != 0)
+  {
+    int event = __builtin_ctzll(flags & mask);
+    uint64_t bit = uint64_t(1) << event;
+    // make sure it is not cleared by another thread between test and clear
+    flags = eventFlags.fetch_and(~bit);
+    if (flags & bit)
+      return event;
+  }
+  return -1;
+}
+/**
+ * write a cleared event to the logfile */
+void UEvent::logCleared(int event)
+{
+  updated();
+  if (telemetry.isOpen())
+    telemetry.add(URecorder::REC_EVENT, dataTime, URecorder::RecEvent{-1, event});
+  if (logfile != NULL)
+  { // flag is cleared - put in log
+    switch (event)
+    {
+      case  0: logWriter.print(logfile, "%ld.%03ld -1 %2d (stop)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
+      case 33: logWriter.print(logfile, "%ld.%03ld -1 %2d (start)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
+      case 30: logWriter.print(logfile, "%ld.%03ld -1 %2d (next snippet)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
+      case 31: logWriter.print(logfile, "%ld.%03ld -1 %2d (next snippet)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
+      default: logWriter.print(logfile, "%ld.%03ld -1 %2d\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
+    }
+  }
 }
 /**
  * Requests if this event has occured.
@@ -119,26 +161,62 @@ void UEvent::clearEvents()
 bool UEvent::isEventSet ( int event )
 {
   bool set = false;
-  if (event <= MAX_EVENT_FLAGS and event >= 0)
-  { // make sure it is not updated between test and set
-    eventUpdate.lock();
-    set = eventFlags[event];
-    eventFlags[event] = 0;
-    updated();
-    eventUpdate.unlock();
-    if (logfile != NULL and set)
-    { // flag is cleared - put in log
-      switch (event)
-      {
-        case  0: fprintf(logfile, "%ld.%03ld -1 %2d (stop)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
-        case 33: fprintf(logfile, "%ld.%03ld -1 %2d (start)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
-        case 30: fprintf(logfile, "%ld.%03ld -1 %2d (next snippet)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
-        case 31: fprintf(logfile, "%ld.%03ld -1 %2d (next snippet)\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
-        default: fprintf(logfile, "%ld.%03ld -1 %2d\n", dataTime.tv_sec, dataTime.tv_usec / 1000, event); break;
+  if (event < MAX_EVENT_FLAGS and event >= 0)
+  { // lock-free test and clear
+    set = takeEvent(uint64_t(1) << event) >= 0;
+    if (set)
+      logCleared(event);
+  }
+  return set;
+}
+/**
+ * Wait for one event */
+float UEvent::waitFor(int event, float timeout)
+{
+  if (event < MAX_EVENT_FLAGS and event >= 0)
+    return waitForAny(uint64_t(1) << event, timeout);
+  return -1;
+}
+/**
+ * Wait for one of a set of events */
+float UEvent::waitForAny(uint64_t mask, float timeout, int * event)
+{
+  auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(long(timeout * 1e6));
+  int ev = -1;
+  timeval setTime;
+  { // wait with the lock released
+    unique_lock<mutex> lock(eventUpdate);
+    while (true)
+    {
+      ev = takeEvent(mask);
+      if (ev >= 0)
+      { // set time is protected by lock
+        setTime = eventTime[ev];
+        break;
+      }
+      if (timeout <= 0)
+        // no timeout
+        eventSignal.wait(lock);
+      else if (eventSignal.wait_until(lock, until) == cv_status::timeout)
+      { // may be set just at timeout
+        ev = takeEvent(mask);
+        if (ev >= 0)
+          setTime = eventTime[ev];
+        break;
       }
     }
   }
-  return set;
+  if (event != NULL)
+    *event = ev;
+  if (ev < 0)
+    return -1;
+  logCleared(ev);
+  timeval t;
+  gettimeofday(&t, NULL);
+  waitLatencyMs = getTimeDiff(t, setTime) * 1000.0;
+  if (waitLatencyMs > waitLatencyMsMax)
+    waitLatencyMsMax = waitLatencyMs;
+  return waitLatencyMs;
 }
 
 void UEvent::subscribe()
@@ -152,16 +230,19 @@ void UEvent::printStatus()
 {
   int eventCnt = 0;
   printf("# ------- Events ----------\n");
+  uint64_t flags = eventFlags.load();
   for (int i = 0; i < MAX_EVENT_FLAGS; i++)
   {
-    if (eventFlags[i])
+    if (flags & (uint64_t(1) << i))
     {
-      printf("# event %d is set", i);
+      printf("# event %d is set\n", i);
       eventCnt++;
     }
   }
   if (eventCnt == 0)
     printf("# No events active.\n");
   printf("# data age %.3fs for event from bridge\n", getTimeSinceUpdate());
+  if (waitLatencyMs >= 0)
+    printf("# wait wake-up latency %.3fms (max %.3fms)\n", waitLatencyMs, waitLatencyMsMax);
   printf("# logfile active=%d\n", logfile != NULL);
 }
@@ -0,0 +1,139 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <opencv2/imgcodecs.hpp>
+#include "uimagesaver.h"
+#include "utime.h"
+
+
+UImageSaver::~UImageSaver()
+{
+  stop();
+}
+
+void UImageSaver::start(int threads)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  stopping = false;
+  for (int i = workers.size(); i < threads; i++)
+    workers.push_back(new std::thread(&UImageSaver::run, this));
+}
+
+void UImageSaver::stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  hasJob.notify_all();
+  for (std::thread * t : workers)
+  {
+    t->join();
+    delete t;
+  }
+  workers.clear();
+}
+
+const char * UImageSaver::extension(int channels)
+{
+  switch (format)
+  {
+    case SAVE_JPEG:
+      return ".jpg";
+    case SAVE_RAW:
+      if (channels == 1)
+        return ".pgm";
+      return ".ppm";
+    default:
+      return ".png";
+  }
+}
+
+bool UImageSaver::save(const cv::Mat & im, const char * basename, std::string * filename)
+{
+  Job job;
+  job.image = im;
+  job.name = basename;
+  job.name += extension(im.channels());
+  switch (format)
+  {
+    case SAVE_JPEG:
+      job.params.push_back(cv::IMWRITE_JPEG_QUALITY);
+      job.params.push_back(jpegQuality);
+      break;
+    case SAVE_RAW:
+      job.params.push_back(cv::IMWRITE_PXM_BINARY);
+      job.params.push_back(1);
+      break;
+    default:
+      job.params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+      job.params.push_back(pngLevel);
+      break;
+  }
+  if (filename != NULL)
+    *filename = job.name;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (workers.empty() or (int)jobs.size() >= maxQueue)
+    { // never wait for the disk
+      dropCnt++;
+      return false;
+    }
+    jobs.push_back(job);
+  }
+  hasJob.notify_one();
+  return true;
+}
+
+void UImageSaver::run()
+{
+  UTime t;
+  while (true)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      hasJob.wait(guard, [this]{ return stopping or not jobs.empty(); });
+      if (jobs.empty())
+        // stopping and all saved
+        break;
+      job = jobs.front();
+      jobs.pop_front();
+    }
+    t.now();
+    if (cv::imwrite(job.name, job.image, job.params))
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      savedCnt++;
+      saveMs = (saveMs * 7 + t.getTimePassed() * 1000) / 8;
+    }
+    else
+      printf("# UImageSaver: failed to save %s\n", job.name.c_str());
+  }
+}
+
+void UImageSaver::printStatus()
+{
+  const char * fmt[] = {"PNG", "JPEG", "raw"};
+  std::lock_guard<std::mutex> guard(lock);
+  printf("# image saver: %s (png level %d, jpeg quality %d), %d threads, %d saved, %d dropped, %d waiting, save %.1f ms\n",
+         fmt[format], pngLevel, jpegQuality, (int)workers.size(), savedCnt, dropCnt, (int)jobs.size(), saveMs);
+}
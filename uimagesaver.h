@@ -0,0 +1,101 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UIMAGESAVER_H
+#define UIMAGESAVER_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+/**
+ * Saves images to disk from one or more background threads,
+ * so compression and flash write do not delay the camera.
+ * Images wait in a bounded queue, if the queue is full the
+ * image is dropped (and counted) rather than waiting. */
+class UImageSaver
+{
+public:
+  enum SaveFormat {
+    SAVE_PNG,   ///< lossless, compression level in pngLevel (slow)
+    SAVE_JPEG,  ///< lossy, quality in jpegQuality
+    SAVE_RAW    ///< uncompressed PNM (.pgm or .ppm) for later conversion (fast)
+  };
+  /// file format for images added from now on
+  SaveFormat format = SAVE_PNG;
+  /// PNG compression level 0..9 (9 is smallest and slowest)
+  int pngLevel = 6;
+  /// JPEG quality 0..100
+  int jpegQuality = 90;
+  /// max number of images waiting to be saved
+  int maxQueue = 4;
+public:
+  /** destructor - saves waiting images */
+  ~UImageSaver();
+  /**
+   * Start encoder threads (if not started already)
+   * \param threads is number of encoder threads */
+  void start(int threads = 1);
+  /**
+   * Stop encoder threads when waiting images are saved */
+  void stop();
+  /**
+   * Add image to save queue.
+   * The image data is not copied, so the image must not be modified afterwards.
+   * \param im is 8-bit gray or BGR image
+   * \param basename is filename without extension, the extension is added from format
+   * \param filename is set to the full filename (if not NULL)
+   * \returns false if image is dropped (queue full) */
+  bool save(const cv::Mat & im, const char * basename, std::string * filename = NULL);
+  /**
+   * Extension for current format, including the dot
+   * \param channels is image channels (raw format differs for gray and colour) */
+  const char * extension(int channels);
+  /**
+   * print status (one line) */
+  void printStatus();
+  /// number of saved and dropped images
+  int savedCnt = 0;
+  int dropCnt = 0;
+private:
+  /** encoder thread */
+  void run();
+  /** one waiting image */
+  struct Job
+  {
+    cv::Mat image;
+    std::string name;
+    std::vector<int> params;
+  };
+  std::deque<Job> jobs;
+  std::vector<std::thread *> workers;
+  std::mutex lock;
+  std::condition_variable hasJob;
+  bool stopping = false;
+  /// average save time (ms)
+  float saveMs = 0;
+};
+
+#endif
@@ -25,6 +25,9 @@ UInfo::UInfo(UBridge * bridge_ptr, bool openlog)
 {
   bridge = bridge_ptr;
   gettimeofday(&bootTime, NULL);
+  bridge->registerMessage("hbt", this, [](UData * item, char * msg) { ((UInfo*)item)->decodeHbt(msg); });
+  bridge->registerMessage("mis", this, [](UData * item, char * msg) { ((UInfo*)item)->decodeMission(msg); });
+  bridge->registerMessage("rid", this, [](UData * item, char * msg) { ((UInfo*)item)->decodeId(msg); });
   // default
   strncpy(robotname, "no name", MAX_NAME_LENGTH);
   if (openlog)
@@ -76,7 +79,7 @@ void UInfo::saveDataToLog()
   {
     timeval t;
     gettimeofday(&t, NULL);
-    fprintf(logfile, "%ld.%03ld %.3f %.1f %.2f %d %d %d %.1f %d\n", t.tv_sec, t.tv_usec / 1000, 
+    logWriter.print(logfile, "%ld.%03ld %.3f %.1f %.2f %d %d %d %.1f %d\n", t.tv_sec, t.tv_usec / 1000, 
             regbotTime, bridgeLoad,
             batteryVoltage,
             missionRunning, missionLineNum, missionThread, float(controlTime)*100.0/1000.0, msgCnt1sec
@@ -24,6 +24,7 @@
 UIRdist::UIRdist(UBridge* bridge_ptr, bool openlog)
 {
   bridge = bridge_ptr;
+  bridge->registerMessage("irc", this, [](UData * item, char * msg) { ((UIRdist*)item)->decode(msg); });
   if (openlog)
     openLog();
 }
@@ -52,9 +53,14 @@ void UIRdist::decode(char* msg)
   raw[0] = strtol(p1, &p1, 10);
   raw[1] = strtol(p1, &p1, 10);
   updated();
+  Snapshot ds = {dataTime, {dist[0], dist[1]}, {raw[0], raw[1]}};
+  snap.write(ds);
+  if (telemetry.isOpen())
+    telemetry.add(URecorder::REC_IR, dataTime, 
+                  URecorder::RecIr{{dist[0], dist[1]}, {raw[0], raw[1]}});
   if (logfile != NULL)
   {
-    fprintf(logfile, "%ld.%03ld %.3f %.3f %d %d\n", dataTime.tv_sec, dataTime.tv_usec / 1000, dist[0], dist[1], raw[0], raw[1]);
+    logWriter.print(logfile, "%ld.%03ld %.3f %.3f %d %d\n", dataTime.tv_sec, dataTime.tv_usec / 1000, dist[0], dist[1], raw[0], raw[1]);
   }
 }
 
@@ -24,6 +24,7 @@
 UJoy::UJoy(UBridge * bridge_ptr, bool openLog)
 {
   bridge = bridge_ptr;
+  bridge->registerMessage("joy", this, [](UData * item, char * msg) { ((UJoy*)item)->decode(msg); });
 }
 
 /**
@@ -76,13 +77,16 @@ void UJoy::decode(char * msg)
   updated();
   if (logIsOpen())
   {
-    fprintf(logfile, "%ld.%03ld ", 
+    // build the line, so it is logged as one
+    const int MSL = 200;
+    char s[MSL];
+    int n = snprintf(s, MSL, "%ld.%03ld ", 
             dataTime.tv_sec, dataTime.tv_usec / 1000);
     for (int i = 0; i < 8; i++)
-      fprintf(logfile, "%d ", axes[i]);
+      n += snprintf(&s[n], MSL - n, "%d ", axes[i]);
     for (int i = 0; i < 11; i++)
-      fprintf(logfile, "%d ", button[i]);
-    fprintf(logfile,"\n");
+      n += snprintf(&s[n], MSL - n, "%d ", button[i]);
+    logWriter.print(logfile, "%s\n", s);
   }
 }
 
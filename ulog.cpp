@@ -0,0 +1,182 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "ulog.h"
+
+ULogWriter logWriter;
+
+thread_local ULogWriter::Queue * ULogWriter::threadQueue = NULL;
+
+
+ULogWriter::~ULogWriter()
+{
+  stop();
+  flush();
+  closed = true;
+  for (FILE * f : retired)
+    fclose(f);
+}
+
+ULogWriter::Queue * ULogWriter::getQueue()
+{
+  if (threadQueue == NULL)
+  { // first log line from this thread
+    std::lock_guard<std::mutex> lock(queueMtx);
+    threadQueue = new Queue;
+    queues.push_back(threadQueue);
+    if (th1 == NULL)
+      start();
+  }
+  return threadQueue;
+}
+
+void ULogWriter::print(FILE * f, const char * format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  if (closed)
+  { // writer is gone (end of program)
+    vfprintf(f, format, ap);
+  }
+  else
+  {
+    Queue * q = getQueue();
+    uint32_t h = q->head.load(std::memory_order_relaxed);
+    if (h - q->tail.load(std::memory_order_acquire) >= (uint32_t)QUEUE_SIZE)
+      // queue is full - writer is too slow
+      q->dropped++;
+    else
+    {
+      Line & line = q->line[h % QUEUE_SIZE];
+      int n = vsnprintf(line.s, MAX_LINE_LENGTH, format, ap);
+      if (n < 0)
+        // format error - nothing to write
+        n = 0;
+      else if (n >= MAX_LINE_LENGTH)
+      { // truncated, but keep line end
+        n = MAX_LINE_LENGTH - 1;
+        line.s[n - 1] = '\n';
+      }
+      line.f = f;
+      line.len = n;
+      q->head.store(h + 1, std::memory_order_release);
+    }
+  }
+  va_end(ap);
+}
+
+void ULogWriter::flush()
+{
+  std::lock_guard<std::mutex> lock(queueMtx);
+  flushLocked();
+}
+
+void ULogWriter::flushLocked()
+{
+  const int MFC = 16;
+  FILE * files[MFC];
+  int filesCnt = 0;
+  for (Queue * q : queues)
+  {
+    uint32_t t = q->tail.load(std::memory_order_relaxed);
+    uint32_t h = q->head.load(std::memory_order_acquire);
+    while (t != h)
+    {
+      Line & line = q->line[t % QUEUE_SIZE];
+      if (not retired.empty() and retired.count(line.f) > 0)
+      { // file is closed since this line was made
+        lateCnt++;
+        t++;
+        continue;
+      }
+      fwrite(line.s, 1, line.len, line.f);
+      writtenCnt++;
+      // note file for flush
+      int i = 0;
+      while (i < filesCnt and files[i] != line.f)
+        i++;
+      if (i == filesCnt and filesCnt < MFC)
+        files[filesCnt++] = line.f;
+      else if (i == filesCnt)
+        fflush(line.f);
+      t++;
+    }
+    q->tail.store(t, std::memory_order_release);
+  }
+  for (int i = 0; i < filesCnt; i++)
+    fflush(files[i]);
+}
+
+void ULogWriter::close(FILE * f)
+{ // no writes to the file after the lock is released
+  std::lock_guard<std::mutex> lock(queueMtx);
+  flushLocked();
+  if (retired.count(f) > 0)
+    return;
+  // close the file, but keep the FILE object valid for late users
+  if (freopen("/dev/null", "w", f) == NULL)
+    // FILE is closed anyhow, but was not freed
+    perror("ULogWriter::close");
+  retired.insert(f);
+}
+
+void ULogWriter::run()
+{
+  timeval t0, t1;
+  while (not th1stop)
+  { // sleep in small steps to stop fast
+    int ms = 0;
+    while (ms < flushIntervalMs and not th1stop)
+    {
+      usleep(10000);
+      ms += 10;
+    }
+    gettimeofday(&t0, NULL);
+    flush();
+    gettimeofday(&t1, NULL);
+    if (getTimeDiff(t1, t0) * 1000.0 > flushIntervalMs)
+      slowWriteCnt++;
+  }
+}
+
+void ULogWriter::printStatus()
+{
+  uint32_t dropped = 0;
+  uint32_t queued = 0;
+  uint32_t late;
+  int threads;
+  {
+    std::lock_guard<std::mutex> lock(queueMtx);
+    for (Queue * q : queues)
+    {
+      dropped += q->dropped.load();
+      queued += q->head.load() - q->tail.load();
+    }
+    threads = queues.size();
+    late = lateCnt;
+  }
+  printf("# log writer: %d threads, %llu lines written, %u queued, %u dropped, %u after file close\n",
+         threads, (unsigned long long)writtenCnt, queued, dropped, late);
+  printf("# log writer: flush every %dms, %d slow writes\n", flushIntervalMs, slowWriteCnt);
+}
@@ -0,0 +1,114 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef ULOG_H
+#define ULOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <set>
+#include "urun.h"
+
+/**
+ * Asynchronous writer for all logfiles.
+ * A thread formats a log line into its own queue (no lock and no file access),
+ * and one writer thread writes all queued lines every flushIntervalMs.
+ * If a queue is full, then the line is dropped and counted.
+ * The line format is unchanged, as the format string is used as is. */
+class ULogWriter : public URun
+{
+public:
+  /// maximum length of one log line (longer lines are truncated)
+  static const int MAX_LINE_LENGTH = 640;
+  /// number of lines in each thread queue
+  static const int QUEUE_SIZE = 2048;
+  /// time between writes to disk (ms)
+  int flushIntervalMs = 100;
+  /** destructor - writes the remaining lines */
+  ~ULogWriter();
+  /**
+   * Add a line to a logfile - like fprintf, but returns at once.
+   * \param f is the logfile to write to
+   * \param format is a printf format string, typically ending with a newline. */
+  void print(FILE * f, const char * format, ...) __attribute__((format(printf, 3, 4)));
+  /**
+   * Write all queued lines to the files now */
+  void flush();
+  /**
+   * Write queued lines and close the logfile,
+   * should be used in place of fclose.
+   * The caller should stop using the file pointer first, lines for the file
+   * from a thread that used it during the close are dropped
+   * (the FILE object is kept on /dev/null until the writer ends). */
+  void close(FILE * f);
+  /**
+   * Writer thread */
+  void run() override;
+  /**
+   * Print number of written and dropped lines */
+  void printStatus();
+  
+private:
+  struct Line
+  {
+    FILE * f;
+    int len;
+    char s[MAX_LINE_LENGTH];
+  };
+  /** single producer, single consumer queue for one thread */
+  struct Queue
+  {
+    Line line[QUEUE_SIZE];
+    std::atomic<uint32_t> head = {0};
+    std::atomic<uint32_t> tail = {0};
+    std::atomic<uint32_t> dropped = {0};
+  };
+  /** get (or create) queue for this thread */
+  Queue * getQueue();
+  /** the queue of the calling thread */
+  static thread_local Queue * threadQueue;
+  /** queues from all threads using the log */
+  std::vector<Queue*> queues;
+  /** lock for the queue list and for emptying the queues */
+  std::mutex queueMtx;
+  /** set when the writer is stopped - logging is then direct */
+  std::atomic<bool> closed = {false};
+  /**
+   * Closed files, the FILE objects are not freed, so late lines can not
+   * use freed memory, and the address is not reused by a new file (protected by queueMtx) */
+  std::set<FILE*> retired;
+  /** lines dropped, as they arrived after the file was closed */
+  uint32_t lateCnt = 0;
+  /** write queued lines, queueMtx must be locked */
+  void flushLocked();
+  /** lines written */
+  uint64_t writtenCnt = 0;
+  /** number of times the write took longer than the flush interval */
+  int slowWriteCnt = 0;
+};
+
+/** the logfile writer used by all logfiles */
+extern ULogWriter logWriter;
+
+#endif
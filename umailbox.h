@@ -0,0 +1,86 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UMAILBOX_H
+#define UMAILBOX_H
+
+#include <atomic>
+
+/**
+ * Latest-value mailbox between one writer thread and one reader thread
+ * (triple buffer). The writer fills its own slot and publishes it,
+ * the reader takes the newest published slot, neither waits for the other.
+ * Older values not taken by the reader are overwritten.
+ * A taken slot is not touched by the writer until the reader takes a new one,
+ * so the reader may use (and modify) it in place. */
+template <class T>
+class UMailbox
+{
+public:
+  /**
+   * Slot to fill by the writer (before publish()) */
+  T & writeSlot()
+  {
+    return slot[back];
+  }
+  /**
+   * Publish the write slot as the newest value */
+  void publish()
+  {
+    int old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    back = old & INDEX;
+  }
+  /**
+   * Is there a value newer than the one taken by the reader */
+  bool hasNew() const
+  {
+    return (middle.load(std::memory_order_acquire) & FRESH) != 0;
+  }
+  /**
+   * Take the newest value (reader only)
+   * \returns false if there is no newer value, then readSlot() is unchanged */
+  bool take()
+  {
+    if (not hasNew())
+      return false;
+    int old = middle.exchange(front, std::memory_order_acq_rel);
+    front = old & INDEX;
+    return true;
+  }
+  /**
+   * Slot taken by the reader */
+  T & readSlot()
+  {
+    return slot[front];
+  }
+private:
+  static const int INDEX = 3;
+  static const int FRESH = 4;
+  T slot[3];
+  /// owned by the writer
+  int back = 0;
+  /// shared, slot index and fresh flag
+  std::atomic<int> middle = {1};
+  /// owned by the reader
+  int front = 2;
+};
+
+#endif
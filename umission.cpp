@@ -45,6 +45,21 @@ UMission::UMission(UBridge * regbot/*, UCamera * camera*/) {
 //   play.say("What a nice day for a stroll\n", 100);
 //   sleep(5);
   computerVision = new CVPositions();
+  // functions that can be called from loaded missions ('do=<name> [value]')
+  // arm hooks give result -1 if the arm snippet did not finish in time (if snippetWaitTimeout is set)
+  plan.addHook("setArm", [this](int pose) { return setArm(pose) ? 0 : -1; });
+  plan.addHook("parkArm", [this](int) { return parkArm() ? 0 : -1; });
+  plan.addHook("disableArm", [this](int) { return disableArm() ? 0 : -1; });
+  plan.addHook("visionStart", [this](int save) { computerVision->init(false, save != 0); return 0; });
+  plan.addHook("visionStop", [this](int) { computerVision->shutdown(); return 0; });
+  plan.addHook("treeColor", [this](int) {
+    // tree colour (RED or WHITE), as in mission_appleTree_Identifier,
+    // -1 if no colour is found within the time limit
+    float certainty;
+    int color = computerVision->treeColor(30, 0.95, certainty);
+    printf("# tree colour %d (confidence %.3f)\n", color, certainty);
+    return color;
+  });
 }
 
 UMission::~UMission() {
@@ -64,6 +79,9 @@ void UMission::printStatus() {
   printf("# ------- Mission ----------\n");
   printf("# active = %d, finished = %d\n", active, finished);
   printf("# mission part=%d, in state=%d\n", mission, missionState);
+  printf("# last snippet send in %.1f ms, snippet to motion %.1f ms (average %.1f ms over %d)\n",
+         snippetUploadMs, snippetMotionMs, 
+         snippetMotionMsSum / maxi(snippetMotionCnt, 1), snippetMotionCnt);
 }
   
 /**
@@ -71,9 +89,12 @@ void UMission::printStatus() {
  * It further initializes a (maximum) number of mission lines 
  * in the REGBOT microprocessor. */
 void UMission::missionInit() { // stop any not-finished mission
-  bridge->send("robot stop\n");
+  const int MAX_INIT_LINES = 2 * missionLineMax + 6;
+  const char * initLines[MAX_INIT_LINES];
+  int n = 0;
+  initLines[n++] = "robot stop\n";
   // clear old mission
-  bridge->send("robot <clear\n");
+  initLines[n++] = "robot <clear\n";
   //
   // add new mission with 3 threads
   // one (100) starting at event 30 and stopping at event 31
@@ -81,24 +102,25 @@ void UMission::missionInit() { // stop any not-finished mission
   // one (  1) used for idle and initialisation of hardware
   // the mission is started, but staying in place (velocity=0, so servo action)
   //
-  bridge->send("robot <add thread=1\n");
+  initLines[n++] = "robot <add thread=1\n";
   // Irsensor should be activated a good time before use 
   // otherwise first samples will produce "false" positive (too short/negative).
-  bridge->send("robot <add irsensor=1,vel=0:dist<0.2\n");
+  initLines[n++] = "robot <add irsensor=1,vel=0:dist<0.2\n";
   //
   // alternating threads (100 and 101, alternating on event 30 and 31 (last 2 events)
-  bridge->send("robot <add thread=100,event=30 : event=31\n");
+  initLines[n++] = "robot <add thread=100,event=30 : event=31\n";
   for (int i = 0; i < missionLineMax; i++)
     // send placeholder lines, that will never finish
     // are to be replaced with real mission
     // NB - hereafter no lines can be added to these threads, just modified
-    bridge->send("robot <add vel=0 : time=0.1\n");
+    initLines[n++] = "robot <add vel=0 : time=0.1\n";
   //
-  bridge->send("robot <add thread=101,event=31 : event=30\n");
+  initLines[n++] = "robot <add thread=101,event=31 : event=30\n";
   for (int i = 0; i < missionLineMax; i++)
     // send placeholder lines, that will never finish
-    bridge->send("robot <add vel=0 : time=0.1\n");
-  usleep(10000);
+    initLines[n++] = "robot <add vel=0 : time=0.1\n";
+  // send as few blocks as flow control allows
+  bridge->sendBatch(initLines, n);
 
   // send subscribe to bridge
   bridge->pose->subscribe();
@@ -119,15 +141,15 @@ void UMission::sendAndActivateSnippet(char ** missionLines, int missionLineCnt)
   // Calling sendAndActivateSnippet automatically toggles between thread 100 and 101. 
   // Modifies the currently inactive thread and then makes it active. 
   const int MSL = 100;
-  char s[MSL];
-  int threadToMod = 101;
-  int startEvent = 31;
+  char s[missionLineMax + 1][MSL];
+  const char * cmds[missionLineMax + 1];
+  int n = 0;
   // select Regbot thread to modify
   // and event to activate it
-  if (threadActive == 101) {
-    threadToMod = 100;
+  int threadToMod = snippetThread();
+  int startEvent = 31;
+  if (threadToMod == 100)
     startEvent = 30;
-  }
   if (missionLineCnt > missionLineMax) {
     printf("# ----------- error - too many lines ------------\n");
     printf("# You tried to send %d lines, but there is buffer space for %d only!\n", missionLineCnt, missionLineMax);
@@ -136,26 +158,66 @@ void UMission::sendAndActivateSnippet(char ** missionLines, int missionLineCnt)
     printf("# -----------------------------------------------\n");
     missionLineCnt = missionLineMax;
   }
-  // send mission lines using '<mod ...' command
-  for (int i = 0; i < missionLineCnt; i++) { // send lines one at a time
+  // make mission lines using '<mod ...' command
+  for (int i = 0; i < missionLineCnt; i++) { // one modify line command for each line
     if (strlen((char*)missionLines[i]) > 0) { // send a modify line command
-      snprintf(s, MSL, "<mod %d %d %s\n", threadToMod, i+1, missionLines[i]);
-      bridge->send(s); 
+      snprintf(s[n], MSL, "<mod %d %d %s\n", threadToMod, i+1, missionLines[i]);
+      cmds[n] = s[n];
+      n++;
     }
     else
       // an empty line will end code snippet too
       break;
   }
-  // let it sink in (10ms)
-  usleep(10000);
-  // Activate new snippet thread and stop the other  
-  snprintf(s, MSL, "<event=%d\n", startEvent);
-  bridge->send(s);
+  // Activate new snippet thread and stop the other
+  // (REGBOT handles commands in order, so no need to wait for the lines to sink in)
+  snprintf(s[n], MSL, "<event=%d\n", startEvent);
+  cmds[n] = s[n];
+  n++;
+  activateSnippet(cmds, n, threadToMod);
+}
+
+void UMission::activateSnippet(const char * cmds[], int n, int threadToMod) {
+  // measure time from snippet to robot motion, if robot is not moving already
+  UMotor::Snapshot ms = bridge->motor->snapshot();
+  snippetTiming = fabsf(ms.velocity[0]) + fabsf(ms.velocity[1]) < 0.02;
+  snippetTime.now();
+  bridge->sendBatch(cmds, n);
+  snippetUploadMs = snippetTime.getTimePassed() * 1000.0;
   // save active thread numbers
   threadActive = threadToMod;
 }
 
-void UMission::parkArm() {
+void UMission::checkSnippetLatency() {
+  if (snippetTiming) {
+    UMotor::Snapshot ms = bridge->motor->snapshot();
+    UTime t;
+    t.setTime(ms.moveStart);
+    if (t > snippetTime) { // robot started moving after snippet was send
+      snippetTiming = false;
+      snippetMotionMs = (t - snippetTime) * 1000.0;
+      snippetMotionMsSum += snippetMotionMs;
+      snippetMotionCnt++;
+      printf("# snippet send in %.1f ms, robot moving after %.1f ms\n", snippetUploadMs, snippetMotionMs);
+    }
+    else if (snippetTime.getTimePassed() > 3.0)
+      // snippet without motion (e.g. servo only)
+      snippetTiming = false;
+  }
+}
+
+bool UMission::waitForSnippet(int event, const char * caller) {
+  float latency = bridge->event->waitFor(event, snippetWaitTimeout);
+  if (latency < 0) {
+    printf("# UMission::%s: no event %d within %gs - failed\n", caller, event, snippetWaitTimeout);
+    return false;
+  }
+  if (debugWaitLatency)
+    printf("# UMission::%s: event %d wake-up latency %.3fms\n", caller, event, latency);
+  return true;
+}
+
+bool UMission::parkArm() {
   int line = 0;
   int parkLoc = 450;
 
@@ -190,14 +252,15 @@ void UMission::parkArm() {
   
   sendAndActivateSnippet(lines, line);
 
-  while(!(bridge->event->isEventSet(1))) {
-    //do nothing
-  }
+  // sleep until the snippet is finished (event 1)
+  bool isOK = waitForSnippet(1, "parkArm");
 
-  disableArm();
+  // disable also if parking failed
+  bool disabled = disableArm();
+  return isOK and disabled;
 }
 
-void UMission::disableArm() {
+bool UMission::disableArm() {
 
   printf("Inside disableArm()\n");
 
@@ -212,12 +275,11 @@ void UMission::disableArm() {
 
   sendAndActivateSnippet(lines, line);
 
-  while(!(bridge->event->isEventSet(1))) {
-    //do nothing
-  }
+  // sleep until the snippet is finished (event 1)
+  return waitForSnippet(1, "disableArm");
 }
 
-void UMission::setArm(int armPose) {
+bool UMission::setArm(int armPose) {
 
   printf("Inside setArm()\n");
 
@@ -231,9 +293,8 @@ void UMission::setArm(int armPose) {
 
   sendAndActivateSnippet(lines, line);
 
-  while(!(bridge->event->isEventSet(1))) {
-    //do nothing
-  }
+  // sleep until the snippet is finished (event 1)
+  return waitForSnippet(1, "setArm");
 }
 
 //////////////////////////////////////////////////////////
@@ -315,56 +376,63 @@ void UMission::runMission() {
           //play.say("Mission resuming", 90);
           //bridge->send("oled 3 running AUTO\n");
         }
-        switch(mission) {
-          case 1:
-            ended = mission_guillotine(missionState);
-            break;
-          case 2:
-            ended = mission_ball_1(missionState);
-            break;
-          case 3:
-            ended = mission_seesaw(missionState);
-            break;
-          case 4:
-            ended = mission_ball_2(missionState);
-            break;
-          case 5:
-            ended = mission_stairs(missionState);
-            break;
-          case 6:
-            ended = mission_parking(missionState);
-            break;
-          // case 7:
-          //   ended = mission_parking_without_closing(missionState);
-          //   break;
-          case 7:
-            ended = mission_parking_with_closing(missionState);
-            break;
-          // case 7:
-          //   ended = mission_skipping_parking(missionState);
-          //   break;
-          // case 8:
-          //   ended = mission_appleTree_Identifier(missionState);
-          //   break;
-          case 8:
-            ended = mission_racetrack(missionState);
-            break;
-          // case 9:
-          //   ended = mission_circleOfHell(missionState);
-          //   break;
-          case 9:
-            ended = mission_skipping_circleOfHell(missionState);
-            break;
-          case 10:
-            ended = mission_appleTree_Identifier_Kids_Edition(missionState);
-            break;
-          case 11:
-            ended = mission_go_to_goal(missionState);
-            break;
-          default:
-            // no more missions - end everything
-            finished = true;
-            break;
+        const UMissionPlan::Mission * planned = plan.find(mission);
+        if (planned != NULL) {
+          // loaded from a mission file
+          ended = runPlan(*planned, missionState);
+        }
+        else {
+          switch(mission) {
+            case 1:
+              ended = mission_guillotine(missionState);
+              break;
+            case 2:
+              ended = mission_ball_1(missionState);
+              break;
+            case 3:
+              ended = mission_seesaw(missionState);
+              break;
+            case 4:
+              ended = mission_ball_2(missionState);
+              break;
+            case 5:
+              ended = mission_stairs(missionState);
+              break;
+            case 6:
+              ended = mission_parking(missionState);
+              break;
+            // case 7:
+            //   ended = mission_parking_without_closing(missionState);
+            //   break;
+            case 7:
+              ended = mission_parking_with_closing(missionState);
+              break;
+            // case 7:
+            //   ended = mission_skipping_parking(missionState);
+            //   break;
+            // case 8:
+            //   ended = mission_appleTree_Identifier(missionState);
+            //   break;
+            case 8:
+              ended = mission_racetrack(missionState);
+              break;
+            // case 9:
+            //   ended = mission_circleOfHell(missionState);
+            //   break;
+            case 9:
+              ended = mission_skipping_circleOfHell(missionState);
+              break;
+            case 10:
+              ended = mission_appleTree_Identifier_Kids_Edition(missionState);
+              break;
+            case 11:
+              ended = mission_go_to_goal(missionState);
+              break;
+            default:
+              // no more missions - end everything
+              finished = true;
+              break;
+          }
         }
         if (ended) { // start next mission part in state 0
           printf("Mission ended\n");
@@ -421,8 +489,13 @@ void UMission::runMission() {
       // stop mission loop
       finished = true;
     }
-    // release CPU a bit (10ms)
-    usleep(10000);
+    checkSnippetLatency();
+    if (planWaited)
+      // has been sleeping while waiting for an event
+      planWaited = false;
+    else
+      // release CPU a bit (10ms)
+      usleep(10000);
   }
   bridge->send("stop\n");
   snprintf(s, MSL, "Robot%s finished.\n", bridge->info->robotname);
@@ -434,6 +507,86 @@ void UMission::runMission() {
 
 ////////////////////////////////////////////////////////////
 
+bool UMission::loadPlan(const char * filename) {
+  bool isOK = plan.load(filename);
+  if (isOK)
+    plan.printStatus();
+  return isOK;
+}
+
+bool UMission::runPlan(const UMissionPlan::Mission & m, int & state) {
+  const int NONE = -2;
+  if (state >= m.stateCnt) { // no (more) states
+    planEntered = -1;
+    return true;
+  }
+  const UMissionPlan::State & st = plan.state(m, state);
+  if (planEntered != state) { // entering state: hooks, then snippet
+    printf(">> Mission %d '%s' state %s\n", m.number, m.name, st.name);
+    planEntered = state;
+    planResult = 0;
+    for (int i = 0; i < st.actionCnt; i++)
+      planResult = plan.call(plan.action(st, i));
+    if (st.cmdCnt > 0) { // formatted when loaded
+      int thread = snippetThread();
+      activateSnippet(plan.commands(st, thread), st.cmdCnt, thread);
+    }
+    planStateTime.now();
+  }
+  // test transitions in order
+  float inState = planStateTime.getTimePassed();
+  // wait no longer than this, so gamepad and stop are tested too
+  float wait = 0.1;
+  int next = NONE;
+  for (int i = 0; i < st.transitionCnt and next == NONE; i++) {
+    const UMissionPlan::Transition & t = plan.transition(st, i);
+    switch (t.condition) {
+      case UMissionPlan::ON_EVENT:
+        if (bridge->event->isEventSet(t.value))
+          next = t.next;
+        break;
+      case UMissionPlan::ON_TIMEOUT:
+        if (inState >= t.timeout)
+          next = t.next;
+        else if (t.timeout - inState < wait)
+          wait = t.timeout - inState;
+        break;
+      case UMissionPlan::ON_RESULT:
+        if (planResult == t.value)
+          next = t.next;
+        break;
+      default:
+        next = t.next;
+        break;
+    }
+  }
+  if (next == NONE) { // sleep until an event in a transition or a timeout
+    int ev = -1;
+    planWaited = true;
+    if (st.eventMask != 0)
+      bridge->event->waitForAny(st.eventMask, wait, &ev);
+    else
+      usleep(wait * 1e6);
+    for (int i = 0; i < st.transitionCnt and ev >= 0; i++) {
+      const UMissionPlan::Transition & t = plan.transition(st, i);
+      if (t.condition == UMissionPlan::ON_EVENT and t.value == ev) {
+        next = t.next;
+        break;
+      }
+    }
+    if (next == NONE)
+      return false;
+  }
+  // enter next state in next call
+  planEntered = -1;
+  if (next == UMissionPlan::END) {
+    printf(">> Mission %d '%s' ended\n", m.number, m.name);
+    return true;
+  }
+  state = next;
+  return false;
+}
+
 bool UMission::mission_guillotine(int & state) {
   bool finished = false;
 
@@ -1838,29 +1991,22 @@ bool UMission::mission_appleTree_Identifier_Kids_Edition(int & state) {
     {
       // Drive to the first tree and grab it
       pose_t trunk_pos;
-      static pose_t trunk_pos_avg;
-
-      int avg = 3;
-
-      static int avg_counter = 0;
+      float confidence;
+      // filtered trunk position must be this certain before a move
+      const float minConfidence = 0.6;
 
       cout << "Get trunk pose" << endl;
 
-      trunk_pos = computerVision->trunkPos();
+      trunk_pos = computerVision->trunkPosFiltered(confidence);
         if(trunk_pos.valid) 
         {
-          cout << "x: " << trunk_pos.x << " y: " << trunk_pos.y << " z: " << trunk_pos.z << endl;
+          cout << "x: " << trunk_pos.x << " y: " << trunk_pos.y << " z: " << trunk_pos.z << " confidence: " << confidence << endl;
 
-          if (avg_counter < avg) {
-            trunk_pos_avg.x += trunk_pos.x;
-            avg_counter++;
-          }
-          else {
-            trunk_pos_avg.x = trunk_pos_avg.x/(double)avg;
-            computerVision->determineMovement(trunk_pos_avg,straight,left,right);
-            printf("Determining movement. x = %f\n",trunk_pos_avg.x);
-            avg_counter = 0;
-            trunk_pos_avg.x = 0;
+          if (confidence >= minConfidence) {
+            computerVision->determineMovement(trunk_pos,straight,left,right);
+            printf("Determining movement. x = %f\n",trunk_pos.x);
+            // the robot moves, so start over
+            computerVision->trunkFilter.reset();
             new_event_ready = true;
           }
           
@@ -2030,28 +2176,21 @@ bool UMission::mission_appleTree_Identifier_Kids_Edition(int & state) {
     case 100: {
            // Drive to the first tree and grab it
       pose_t trunk_pos;
-      static pose_t trunk_pos_avg;
-
-      int avg = 3;
+      float confidence;
+      // filtered trunk position must be this certain before a move
+      const float minConfidence = 0.6;
 
-      static int avg_counter = 0;
 
-
-      trunk_pos = computerVision->trunkPos();
+      trunk_pos = computerVision->trunkPosFiltered(confidence);
         if(trunk_pos.valid) 
         {
-          cout << "x: " << trunk_pos.x << " y: " << trunk_pos.y << " z: " << trunk_pos.z << endl;
+          cout << "x: " << trunk_pos.x << " y: " << trunk_pos.y << " z: " << trunk_pos.z << " confidence: " << confidence << endl;
 
-          if (avg_counter < avg) {
-            trunk_pos_avg.x += trunk_pos.x;
-            avg_counter++;
-          }
-          else {
-            trunk_pos_avg.x = trunk_pos_avg.x/(double)avg;
-            computerVision->determineMovement(trunk_pos_avg,straight,left,right);
-            printf("Determining movement. x = %f\n",trunk_pos_avg.x);
-            avg_counter = 0;
-            trunk_pos_avg.x = 0;
+          if (confidence >= minConfidence) {
+            computerVision->determineMovement(trunk_pos,straight,left,right);
+            printf("Determining movement. x = %f\n",trunk_pos.x);
+            // the robot moves, so start over
+            computerVision->trunkFilter.reset();
             new_event_ready = true;
           }
           
@@ -2206,7 +2345,8 @@ bool UMission::mission_appleTree_Identifier_Kids_Edition(int & state) {
 
 bool UMission::mission_appleTree_Identifier(int & state) {
   bool finished = false;
-  static bool currentTreeColor;
+  static int currentTreeColor = -1;
+  static int colorTries = 0;
 
   // Create the elements that will receive the movement instructions
   bool straight = false, left = false, right = false;
@@ -2223,7 +2363,7 @@ bool UMission::mission_appleTree_Identifier(int & state) {
     
       pose_t result;
       while (!signal_var) {
-        result = computerVision->treeID(RED);
+        result = computerVision->treeID(RED, true);
       }
       signal_var = false;
       state = 999;
@@ -2253,34 +2393,33 @@ bool UMission::mission_appleTree_Identifier(int & state) {
     
     case 30: {
       if (bridge->event->isEventSet(20)) {
-        //Determine which color the tree has
-        pose_t result;
-        bool tempColor;
-        bool colorDetermined = false;
-        int colorCertainty = 0;
-
-        while (colorCertainty < 10) {
-          result = computerVision->treeID(RED);
-          tempColor = result.id;
-
-          if (tempColor == colorDetermined) {
-            colorCertainty++;
-          }
-          else {
-            colorCertainty = 0;
-          }
-          colorDetermined = tempColor;
-        }
-        // Now we are sure of the color
-        currentTreeColor = colorDetermined;
+        colorTries = 0;
+        state = 35;
+      }
+    } break;
 
-        if (currentTreeColor == RED) {
-          printf("Tree is red\n");
-        }
-        else printf("Tree is white\n");
-        
+    case 35: {
+      //Determine which color the tree has
+      float colorCertainty = 0;
+      // -1 if no vote within the time limit
+      int colorDetermined = computerVision->treeColor(30, 0.95, colorCertainty);
+      printf("Tree colour %d (confidence %.3f)\n", colorDetermined, colorCertainty);
+      currentTreeColor = colorDetermined;
+      colorTries++;
+
+      if (currentTreeColor == RED) {
+        printf("Tree is red\n");
         state = 40;
       }
+      else if (currentTreeColor == WHITE) {
+        printf("Tree is white\n");
+        state = 40;
+      }
+      else if (colorTries >= 3) {
+        printf("Tree colour not found after %d tries - mission ended\n", colorTries);
+        state = 999;
+      }
+      // else try again
     } break;
 
 
@@ -2307,27 +2446,20 @@ bool UMission::mission_appleTree_Identifier(int & state) {
       
       // Drive to the first tree and grab it
       pose_t trunk_pos;
-      static pose_t trunk_pos_avg;
-
-      int avg = 3;
-
-      static int avg_counter = 0;
+      float confidence;
+      // filtered trunk position must be this certain before a move
+      const float minConfidence = 0.6;
       
-      trunk_pos = computerVision->trunkPos();
+      trunk_pos = computerVision->trunkPosFiltered(confidence);
         if(trunk_pos.valid) 
         {
-          cout << "x: " << trunk_pos.x << " y: " << trunk_pos.y << " z: " << trunk_pos.z << endl;
+          cout << "x: " << trunk_pos.x << " y: " << trunk_pos.y << " z: " << trunk_pos.z << " confidence: " << confidence << endl;
 
-          if (avg_counter < avg) {
-            trunk_pos_avg.x += trunk_pos.x;
-            avg_counter++;
-          }
-          else {
-            trunk_pos_avg.x = trunk_pos_avg.x/(double)avg;
-            computerVision->determineMovement(trunk_pos_avg,straight,left,right);
-            printf("Determining movement. x = %f\n",trunk_pos_avg.x);
-            avg_counter = 0;
-            trunk_pos_avg.x = 0;
+          if (confidence >= minConfidence) {
+            computerVision->determineMovement(trunk_pos,straight,left,right);
+            printf("Determining movement. x = %f\n",trunk_pos.x);
+            // the robot moves, so start over
+            computerVision->trunkFilter.reset();
             new_event_ready = true;
           }
           
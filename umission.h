@@ -31,6 +31,7 @@
 #include "ujoy.h"
 #include "uplay.h"
 #include "apple_aruco_pose.hpp"
+#include "umissionplan.h"
 
 /**
  * Base class, that makes it easier to starta thread
@@ -78,9 +79,19 @@ public:
   void closeLog();
   inline bool logIsOpen() { return logMission != NULL; };
 
-  void parkArm();
-  void disableArm();
-  void setArm(int armPose);
+  /**
+   * Load mission graphs from file (see umissionplan.h),
+   * a loaded mission replaces the built-in mission with the same number.
+   * \returns false if the file is not found or has errors */
+  bool loadPlan(const char * filename);
+
+  /**
+   * Arm functions, each sends a snippet and waits (sleeping) until it is finished,
+   * but no longer than snippetWaitTimeout (if set)
+   * \returns false if the snippet did not finish in time */
+  bool parkArm();
+  bool disableArm();
+  bool setArm(int armPose);
   /**
    * Run the missions
    * \param fromMission is first mission element (default is 1)
@@ -127,6 +138,12 @@ public:
   int missionState;
   bool new_event_ready = true;
   int event_nr = 8;
+  /** print wake-up latency when waiting for an event */
+  bool debugWaitLatency = false;
+  /**
+   * Max wait (seconds) for an arm snippet to finish,
+   * 0 is wait until finished, as the fixed missions expect the arm to be in place when continuing */
+  float snippetWaitTimeout = 0;
 private:
   /**
    * Mission parts
@@ -149,6 +166,23 @@ private:
   bool mission_appleTree_Identifier_Kids_Edition(int & state);
   
   CVPositions *computerVision;
+  /**
+   * Run a mission loaded from file, each state runs its hooks and sends its snippet
+   * when entered, then waits for an event or timeout in its transitions.
+   * \param m is the loaded mission
+   * \param state is the state index in the mission
+   * \return true, when mission is finished */
+  bool runPlan(const UMissionPlan::Mission & m, int & state);
+  /// loaded missions
+  UMissionPlan plan;
+  /// state entered (hooks and snippet done), -1 if not
+  int planEntered = -1;
+  /// time state was entered
+  UTime planStateTime;
+  /// value from last hook in state
+  int planResult = 0;
+  /// has waited for an event (so no extra sleep in mission loop)
+  bool planWaited = false;
 private:
   /**
    * Send a number of lines to the REGBOT in a dormant thread, and 
@@ -156,9 +190,43 @@ private:
    * \param missionLines is a pointer to an array of c-strings
    * \param missionLineCnt is the number of strings to be send from the missionLine array. */
   void sendAndActivateSnippet(char * missionLines[], int missionLineCnt);
+  /**
+   * Send snippet commands (formatted '<mod' lines and the activate event)
+   * \param cmds is an array of commands, each terminated with a newline
+   * \param cmdCnt is the number of commands
+   * \param threadToMod is the REGBOT thread modified by the commands */
+  void activateSnippet(const char * cmds[], int cmdCnt, int threadToMod);
+  /**
+   * The REGBOT thread to modify for the next snippet (100 or 101) */
+  inline int snippetThread()
+  {
+    if (threadActive == 101)
+      return 100;
+    return 101;
+  }
+  /**
+   * Test if the robot has started moving after the last snippet,
+   * and print the snippet to motion latency */
+  void checkSnippetLatency();
+  /**
+   * Sleep until the event at the end of a snippet is received
+   * \param event is the event set by the last snippet line
+   * \param caller is function name for the messages
+   * \returns false if the event is not received within snippetWaitTimeout */
+  bool waitForSnippet(int event, const char * caller);
   /**
    * Object to play a soundfile as we go */
   USay play;
+  /// time last snippet was send
+  UTime snippetTime;
+  /// waiting for robot to move after last snippet
+  bool snippetTiming = false;
+  /// time to send last snippet (ms)
+  float snippetUploadMs = 0;
+  /// time from snippet send to robot moving (ms), for last snippet and average
+  float snippetMotionMs = -1;
+  float snippetMotionMsSum = 0;
+  int snippetMotionCnt = 0;
   /**
    * turn count, when looking for feature */
   int featureCnt;
@@ -0,0 +1,316 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "umissionplan.h"
+
+
+void UMissionPlan::addHook(const char * name, Hook hook)
+{
+  int i = findHook(name);
+  if (i >= 0)
+    hooks[i] = hook;
+  else
+  {
+    hookNames.push_back(name);
+    hooks.push_back(hook);
+  }
+}
+
+int UMissionPlan::findHook(const char * name) const
+{
+  for (int i = 0; i < (int)hookNames.size(); i++)
+    if (hookNames[i] == name)
+      return i;
+  return -1;
+}
+
+bool UMissionPlan::load(const char * filename)
+{
+  FILE * f = fopen(filename, "r");
+  if (f == NULL)
+  {
+    perror(filename);
+    return false;
+  }
+  // compile into a copy, so an error leaves the loaded missions unchanged
+  UMissionPlan p = *this;
+  int first = p.missions.size();
+  const int MSL = 200;
+  char s[MSL];
+  char where[MSL];
+  int lineNr = 0;
+  bool isOK = true;
+  while (isOK and fgets(s, MSL, f) != NULL)
+  {
+    lineNr++;
+    snprintf(where, MSL, "%s:%d", filename, lineNr);
+    // remove comment and white space
+    char * p1 = strchr(s, '#');
+    if (p1 != NULL)
+      *p1 = '\0';
+    p1 = s;
+    while (isspace(*p1))
+      p1++;
+    char * p2 = p1 + strlen(p1);
+    while (p2 > p1 and isspace(p2[-1]))
+      *--p2 = '\0';
+    if (*p1 != '\0')
+      isOK = p.compileLine(p1, where);
+  }
+  fclose(f);
+  if (isOK)
+    isOK = p.endMission(filename);
+  if (not isOK)
+    return false;
+  // a new mission replaces a loaded mission with the same number
+  for (int i = first; i < (int)p.missions.size(); i++)
+    for (int j = 0; j < first; j++)
+      if (p.missions[j].number == p.missions[i].number)
+      {
+        p.missions.erase(p.missions.begin() + j);
+        first--;
+        i--;
+        break;
+      }
+  *this = p;
+  makePointers();
+  printf("# UMissionPlan: loaded %d missions from %s\n", (int)missions.size() - first, filename);
+  return true;
+}
+
+bool UMissionPlan::compileLine(const char * line, const char * where)
+{
+  const int MNL = MAX_NAME * 2;
+  char name[MNL];
+  if (strncmp(line, "mission=", 8) == 0)
+  {
+    if (not endMission(where))
+      return false;
+    Mission m;
+    char * p1;
+    m.number = strtol(&line[8], &p1, 10);
+    while (isspace(*p1))
+      p1++;
+    snprintf(m.name, sizeof(m.name), "%s", p1);
+    m.firstState = states.size();
+    m.stateCnt = 0;
+    missions.push_back(m);
+    return true;
+  }
+  if (missions.empty())
+  {
+    printf("# UMissionPlan: %s: 'mission=<number>' expected first\n", where);
+    return false;
+  }
+  Mission & m = missions.back();
+  if (strncmp(line, "state=", 6) == 0)
+  {
+    endState();
+    State st = {};
+    snprintf(st.name, MAX_NAME, "%s", &line[6]);
+    for (int i = 0; i < m.stateCnt; i++)
+      if (strcmp(state(m, i).name, st.name) == 0)
+      {
+        printf("# UMissionPlan: %s: state '%s' is defined already\n", where, st.name);
+        return false;
+      }
+    if (strcmp(st.name, "end") == 0 or st.name[0] == '\0')
+    {
+      printf("# UMissionPlan: %s: state name '%s' is not allowed\n", where, st.name);
+      return false;
+    }
+    st.firstAction = actions.size();
+    st.firstTransition = transitions.size();
+    st.firstCmd = cmdOffset.size();
+    states.push_back(st);
+    m.stateCnt++;
+    return true;
+  }
+  if (m.stateCnt == 0)
+  {
+    printf("# UMissionPlan: %s: 'state=<name>' expected\n", where);
+    return false;
+  }
+  State & st = states.back();
+  if (strncmp(line, "do=", 3) == 0)
+  {
+    Action a;
+    a.arg = 0;
+    int n = sscanf(&line[3], "%31s %d", name, &a.arg);
+    a.hook = findHook(name);
+    if (n < 1 or a.hook < 0)
+    {
+      printf("# UMissionPlan: %s: unknown hook '%s'\n", where, &line[3]);
+      return false;
+    }
+    actions.push_back(a);
+    st.actionCnt++;
+    return true;
+  }
+  if (strncmp(line, "on ", 3) == 0)
+  {
+    Transition t = {};
+    char cond[MNL];
+    char go[MNL];
+    if (sscanf(&line[3], "%31s %31s %31s", cond, go, name) != 3 or strcmp(go, "goto") != 0)
+    {
+      printf("# UMissionPlan: %s: expected 'on <condition> goto <state>'\n", where);
+      return false;
+    }
+    if (strncmp(cond, "event=", 6) == 0)
+    {
+      t.condition = ON_EVENT;
+      t.value = strtol(&cond[6], NULL, 10);
+      if (t.value < 1 or t.value > 29)
+      { // 0 is stop, 30, 31 are used for snippets, 33 is start
+        printf("# UMissionPlan: %s: event %d is not available (use 1..29)\n", where, t.value);
+        return false;
+      }
+      st.eventMask |= uint64_t(1) << t.value;
+    }
+    else if (strncmp(cond, "timeout=", 8) == 0)
+    {
+      t.condition = ON_TIMEOUT;
+      t.timeout = strtof(&cond[8], NULL);
+    }
+    else if (strncmp(cond, "result=", 7) == 0)
+    {
+      t.condition = ON_RESULT;
+      t.value = strtol(&cond[7], NULL, 10);
+    }
+    else if (strcmp(cond, "done") == 0)
+      t.condition = ON_DONE;
+    else
+    {
+      printf("# UMissionPlan: %s: unknown condition '%s'\n", where, cond);
+      return false;
+    }
+    gotos.push_back(std::make_pair((int)transitions.size(), std::string(name)));
+    transitions.push_back(t);
+    st.transitionCnt++;
+    return true;
+  }
+  // REGBOT snippet line
+  if (strncmp(line, "thread=", 7) == 0)
+  {
+    printf("# UMissionPlan: %s: 'thread=' is not allowed, snippet threads are %d and %d\n",
+           where, SNIPPET_THREAD_0, SNIPPET_THREAD_0 + 1);
+    return false;
+  }
+  if ((int)snippet.size() >= MAX_SNIPPET_LINES or strlen(line) > 80)
+  {
+    printf("# UMissionPlan: %s: too many (max %d) or too long snippet lines\n", where, MAX_SNIPPET_LINES);
+    return false;
+  }
+  snippet.push_back(line);
+  return true;
+}
+
+void UMissionPlan::endState()
+{
+  if (states.empty() or snippet.empty())
+    return;
+  State & st = states.back();
+  const int MSL = 100;
+  char s[MSL];
+  for (int i = 0; i <= (int)snippet.size(); i++)
+  {
+    cmdOffset.push_back(cmdText[0].size());
+    for (int t = 0; t < 2; t++)
+    { // thread 100 is started by event 30, thread 101 by event 31
+      if (i < (int)snippet.size())
+        snprintf(s, MSL, "<mod %d %d %s\n", SNIPPET_THREAD_0 + t, i + 1, snippet[i].c_str());
+      else
+        snprintf(s, MSL, "<event=%d\n", 30 + t);
+      cmdText[t].insert(cmdText[t].end(), s, s + strlen(s) + 1);
+    }
+  }
+  st.cmdCnt = snippet.size() + 1;
+  snippet.clear();
+}
+
+bool UMissionPlan::endMission(const char * where)
+{
+  endState();
+  if (missions.empty())
+    return true;
+  const Mission & m = missions.back();
+  for (int i = 0; i < m.stateCnt; i++)
+    if (state(m, i).transitionCnt == 0)
+    {
+      printf("# UMissionPlan: %s: mission %d state '%s' has no 'on ... goto'\n",
+             where, m.number, state(m, i).name);
+      return false;
+    }
+  for (const std::pair<int, std::string> & g : gotos)
+  {
+    Transition & t = transitions[g.first];
+    if (g.second == "end")
+      t.next = END;
+    else
+    {
+      t.next = -2;
+      for (int i = 0; i < m.stateCnt; i++)
+        if (g.second == state(m, i).name)
+        {
+          t.next = i;
+          break;
+        }
+      if (t.next == -2)
+      {
+        printf("# UMissionPlan: %s: mission %d has no state '%s'\n", where, m.number, g.second.c_str());
+        return false;
+      }
+    }
+  }
+  gotos.clear();
+  return true;
+}
+
+void UMissionPlan::makePointers()
+{
+  for (int t = 0; t < 2; t++)
+  {
+    cmdPtr[t].resize(cmdOffset.size());
+    for (int i = 0; i < (int)cmdOffset.size(); i++)
+      cmdPtr[t][i] = &cmdText[t][cmdOffset[i]];
+  }
+}
+
+const UMissionPlan::Mission * UMissionPlan::find(int number) const
+{
+  for (const Mission & m : missions)
+    if (m.number == number)
+      return &m;
+  return NULL;
+}
+
+void UMissionPlan::printStatus()
+{
+  printf("# mission plan: %d missions, %d states, %d snippet commands, %d hooks\n",
+         (int)missions.size(), (int)states.size(), (int)cmdOffset.size(), (int)hooks.size());
+  for (const Mission & m : missions)
+    printf("#   mission %d '%s' with %d states\n", m.number, m.name, m.stateCnt);
+}
@@ -0,0 +1,184 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UMISSIONPLAN_H
+#define UMISSIONPLAN_H
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <functional>
+
+/**
+ * Mission graphs loaded from a text file, so a mission can be changed
+ * without a new build. A file holds one or more missions, each is a
+ * list of states with a REGBOT snippet, hooks (C++ functions, e.g. vision)
+ * and transitions. Example:
+ *
+ *     # comments start with '#'
+ *     mission=3 seesaw
+ *     state=10
+ *       do=setArm 550
+ *       vel=0.3, edgel=0, white=1 : dist=0.91
+ *       event=4, vel=0 : dist=1
+ *       on event=4 goto 12
+ *     state=12
+ *       do=treeColor
+ *       on result=0 goto red
+ *       on timeout=5 goto end
+ *
+ * - 'mission=<number> [name]' starts a mission, a mission number here replaces
+ *   the built-in mission with the same number. Missions run in number order until
+ *   the first number without a mission, so other numbers must be started by number.
+ * - 'state=<name>' starts a state, the first state is the start state.
+ * - 'do=<hook> [integer]' calls a hook (see addHook()) when the state is entered,
+ *   the value returned by the last hook is the state result.
+ * - other lines are REGBOT snippet lines (as in the Navigation files),
+ *   sent (as one snippet) after the hooks.
+ * - 'on <condition> goto <state>' is a transition, 'end' ends the mission,
+ *   conditions are tested in order: 'event=<n>' (REGBOT event), 'timeout=<seconds>'
+ *   (time in state), 'result=<n>' (state result) or 'done' (always).
+ *
+ * The file is compiled to tables: states refer to ranges of actions, transitions
+ * and snippet commands, state and hook names are resolved to indices, and all
+ * snippet lines are formatted to REGBOT '<mod' commands (for both snippet threads)
+ * when loaded. */
+class UMissionPlan
+{
+public:
+  /// hook function, called with the integer argument, returns the state result
+  typedef std::function<int(int)> Hook;
+  /// transition conditions
+  enum Condition {ON_EVENT, ON_TIMEOUT, ON_RESULT, ON_DONE};
+  /// max length of names
+  static const int MAX_NAME = 16;
+  /// max snippet lines in a state
+  static const int MAX_SNIPPET_LINES = 30;
+  /// the two REGBOT threads used for snippets (see UMission::missionInit())
+  static const int SNIPPET_THREAD_0 = 100;
+  struct Action
+  {
+    int16_t hook;
+    int32_t arg;
+  };
+  struct Transition
+  {
+    int16_t condition;
+    /// state index, or END
+    int16_t next;
+    /// event number or result
+    int32_t value;
+    float timeout;
+  };
+  struct State
+  {
+    char name[MAX_NAME];
+    int firstAction, actionCnt;
+    int firstTransition, transitionCnt;
+    /// snippet commands, including the activate command (0 if no snippet)
+    int firstCmd, cmdCnt;
+    /// events in the transitions (bit n is event n)
+    uint64_t eventMask;
+  };
+  struct Mission
+  {
+    int number;
+    char name[MAX_NAME * 2];
+    int firstState, stateCnt;
+  };
+  /// next state index for the 'end' of a mission
+  static const int END = -1;
+public:
+  /**
+   * Register a hook function before load(), so 'do=<name>' can be used
+   * \param name is hook name
+   * \param hook is the function */
+  void addHook(const char * name, Hook hook);
+  /**
+   * Load and compile mission file, the missions are added to (or replace)
+   * the missions loaded already
+   * \param filename is the mission file
+   * \returns false if file is not found or has errors (then nothing is added) */
+  bool load(const char * filename);
+  /**
+   * Mission with this number
+   * \returns NULL if not loaded */
+  const Mission * find(int number) const;
+  /** state number 'index' in mission */
+  inline const State & state(const Mission & m, int index) const
+  {
+    return states[m.firstState + index];
+  }
+  inline const Action & action(const State & s, int index) const
+  {
+    return actions[s.firstAction + index];
+  }
+  inline const Transition & transition(const State & s, int index) const
+  {
+    return transitions[s.firstTransition + index];
+  }
+  /**
+   * Snippet commands (cmdCnt of them) ready to send
+   * \param s is the state
+   * \param thread is the REGBOT thread to modify (100 or 101) */
+  inline const char ** commands(const State & s, int thread)
+  {
+    return &cmdPtr[thread != SNIPPET_THREAD_0][s.firstCmd];
+  }
+  /**
+   * Call hook in action */
+  inline int call(const Action & a)
+  {
+    return hooks[a.hook](a.arg);
+  }
+  /**
+   * print loaded missions */
+  void printStatus();
+private:
+  /** compile one line (without comment), returns false on error */
+  bool compileLine(const char * line, const char * where);
+  /** finish the state being compiled (format snippet) */
+  void endState();
+  /** finish the mission being compiled (resolve state names), returns false on error */
+  bool endMission(const char * where);
+  /** find hook by name, -1 if not found */
+  int findHook(const char * name) const;
+  /** make command pointers from offsets */
+  void makePointers();
+  std::vector<Mission> missions;
+  std::vector<State> states;
+  std::vector<Action> actions;
+  std::vector<Transition> transitions;
+  /// formatted commands for thread 100 and 101 ('\0' terminated),
+  /// same length for both threads, so one offset for each command
+  std::vector<char> cmdText[2];
+  std::vector<int> cmdOffset;
+  /// pointers into cmdText
+  std::vector<const char *> cmdPtr[2];
+  /// snippet lines for the state being compiled
+  std::vector<std::string> snippet;
+  /// transition index and state name for the mission being compiled
+  std::vector<std::pair<int, std::string> > gotos;
+  std::vector<std::string> hookNames;
+  std::vector<Hook> hooks;
+};
+
+#endif
@@ -25,6 +25,8 @@
 UMotor::UMotor(UBridge * bridge_ptr, bool openlog)
 {
   bridge = bridge_ptr;
+  bridge->registerMessage("wve", this, [](UData * item, char * msg) { ((UMotor*)item)->decodeVel(msg); });
+  bridge->registerMessage("mca", this, [](UData * item, char * msg) { ((UMotor*)item)->decodeCurrent(msg); });
   if (openlog)
     openLog();
 }
@@ -50,12 +52,21 @@ void UMotor::decodeVel(char * msg)
   velocity[1] = strtof(p1, &p1);
   if (logfile != NULL)
   {
-    fprintf(logfile, "%ld.%03ld %.3f %.3f %.3f %.3f\n", 
+    logWriter.print(logfile, "%ld.%03ld %.3f %.3f %.3f %.3f\n", 
             dataTime.tv_sec, dataTime.tv_usec / 1000,
             velocity[0], velocity[1],
             current[0], current[1]);
   }
+  if (telemetry.isOpen())
+    telemetry.add(URecorder::REC_MOTOR, dataTime, 
+                  URecorder::RecMotor{{velocity[0], velocity[1]}, {current[0], current[1]}});
   updated();  
+  // note when robot starts to move
+  bool isMoving = fabsf(velocity[0]) + fabsf(velocity[1]) > 0.02;
+  if (isMoving and not moving)
+    moveStart = dataTime;
+  moving = isMoving;
+  publish();
 }
 
 
@@ -65,6 +76,13 @@ void UMotor::decodeCurrent(char * msg)
   current[0] = strtof(p1, &p1);
   current[1] = strtof(p1, &p1);
   updated();
+  publish();
+}
+
+void UMotor::publish()
+{ // make values available to other threads
+  Snapshot ds = {dataTime, {velocity[0], velocity[1]}, {current[0], current[1]}, moveStart};
+  snap.write(ds);
 }
 
 
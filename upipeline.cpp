@@ -0,0 +1,123 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include "upipeline.h"
+
+
+UFrameQueue::UFrameQueue(int size)
+{
+  maxSize = maxi(1, size);
+}
+
+void UFrameQueue::push(UVisionFramePtr frame)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    while (frames.size() >= maxSize)
+    { // latest frame wins
+      frames.pop_front();
+      dropCnt++;
+    }
+    frames.push_back(frame);
+  }
+  hasFrame.notify_one();
+}
+
+UVisionFramePtr UFrameQueue::pop(int timeoutMs)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  if (not hasFrame.wait_for(guard, std::chrono::milliseconds(timeoutMs),
+                            [this]{ return not frames.empty(); }))
+    return UVisionFramePtr();
+  UVisionFramePtr frame = frames.front();
+  frames.pop_front();
+  return frame;
+}
+
+void UFrameQueue::clear()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  frames.clear();
+}
+
+//////////////////////////////////////////////////
+
+UVisionStage::UVisionStage(const char * stageName, int queueSize)
+  : input(queueSize)
+{
+  name = stageName;
+}
+
+UVisionStage::~UVisionStage()
+{
+  stop();
+}
+
+void UVisionStage::push(UVisionFramePtr frame)
+{
+  if (not enabled)
+    return;
+  if (copyImage and not frame->image.empty())
+  { // stage may write in image, so make a copy
+    UVisionFramePtr copy(new UVisionFrame(*frame));
+    copy->image = frame->image.clone();
+    input.push(copy);
+  }
+  else
+    input.push(frame);
+}
+
+void UVisionStage::stop()
+{
+  URun::stop();
+  // release any frame lease still waiting
+  input.clear();
+}
+
+void UVisionStage::run()
+{
+  UTime t;
+  while (not th1stop)
+  {
+    UVisionFramePtr frame = input.pop(100);
+    if (not frame or not enabled)
+      continue;
+    t.now();
+    bool passOn = process(*frame);
+    // statistics
+    float dt = t.getTimePassed() * 1000.0;
+    float lat = frame->imTime.getTimePassed() * 1000.0;
+    processedCnt++;
+    procMs = (procMs * 15 + dt) / 16;
+    latencyMs = (latencyMs * 15 + lat) / 16;
+    if (lat > latencyMsMax)
+      latencyMsMax = lat;
+    if (passOn)
+      for (UVisionStage * s : next)
+        s->push(frame);
+  }
+}
+
+void UVisionStage::printStatus()
+{
+  printf("#   %-8s enabled=%d, %6d frames, %5d dropped, process %6.2f ms, latency %6.2f ms (max %.2f ms)\n",
+         name, enabled, processedCnt, input.dropCnt, procMs, latencyMs, latencyMsMax);
+}
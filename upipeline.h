@@ -0,0 +1,143 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UPIPELINE_H
+#define UPIPELINE_H
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+#include "urun.h"
+#include "utime.h"
+#include "ucamera_v4l2.h"
+
+/**
+ * One camera frame passed between the stages of the vision pipeline.
+ * The raw frame lease is released (buffer back to the driver)
+ * as soon as the frame is converted. */
+class UVisionFrame
+{
+public:
+  /// raw frame from driver (until converted)
+  UFrameLease raw;
+  /// converted image (format as mode)
+  cv::Mat image;
+  /// capture mode used when converted
+  UV4l2::CaptureMode mode = UV4l2::CAPTURE_BGR;
+  /// capture time
+  UTime imTime;
+  /// image number
+  int number = 0;
+};
+typedef std::shared_ptr<UVisionFrame> UVisionFramePtr;
+
+/**
+ * Bounded frame queue between two pipeline stages.
+ * When the queue is full the oldest frame is dropped,
+ * so a slow stage always gets the latest frame.
+ * This is a mutex and a deque, not a lock-free ring: dropping the oldest frame
+ * means the producer also removes frames, and the consumer sleeps (with timeout)
+ * until a frame arrives; the lock is held for a pointer push or pop only. */
+class UFrameQueue
+{
+public:
+  /**
+   * \param size is max number of frames waiting */
+  UFrameQueue(int size);
+  /**
+   * Add a frame, drops the oldest frame if the queue is full */
+  void push(UVisionFramePtr frame);
+  /**
+   * Get the oldest frame in queue.
+   * \param timeoutMs is max wait time for a frame
+   * \returns frame or an empty pointer on timeout */
+  UVisionFramePtr pop(int timeoutMs);
+  /**
+   * Remove all frames (releases frame leases) */
+  void clear();
+  /// number of frames dropped, as queue was full
+  int dropCnt = 0;
+private:
+  std::mutex lock;
+  std::condition_variable hasFrame;
+  std::deque<UVisionFramePtr> frames;
+  unsigned int maxSize;
+};
+
+/**
+ * A pipeline stage with its own thread and input queue.
+ * The frame is passed on to all next stages when processed. */
+class UVisionStage : public URun
+{
+public:
+  /**
+   * \param stageName is name used in status print
+   * \param queueSize is max number of frames waiting for this stage */
+  UVisionStage(const char * stageName, int queueSize = 1);
+  /** destructor */
+  virtual ~UVisionStage();
+  /// stage name
+  const char * name;
+  /// disabled stages drop all frames (and do not pass them on)
+  bool enabled = true;
+  /**
+   * stage writes in the image (e.g. debug overlay),
+   * so the stage gets its own copy of the image */
+  bool copyImage = false;
+  /// frames waiting for this stage
+  UFrameQueue input;
+  /**
+   * add stage to get the frames after this stage */
+  void addNext(UVisionStage * stage)
+  {
+    next.push_back(stage);
+  }
+  /**
+   * Give frame to this stage (from previous stage) */
+  void push(UVisionFramePtr frame);
+  /** stop thread and release waiting frames */
+  void stop() override;
+  /**
+   * print stage statistics (one line) */
+  void printStatus();
+  /**
+   * thread loop - wait for frame, process and pass on */
+  void run() override;
+protected:
+  /**
+   * Process one frame.
+   * \returns false if the frame should not be passed to the next stages */
+  virtual bool process(UVisionFrame & frame) = 0;
+private:
+  std::vector<UVisionStage *> next;
+  /// statistics
+  int processedCnt = 0;
+  /// latency from image capture to end of this stage (ms)
+  float latencyMs = 0, latencyMsMax = 0;
+  /// average processing time in this stage (ms)
+  float procMs = 0;
+};
+
+#endif
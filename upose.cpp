@@ -24,6 +24,7 @@
 UPoseInfo::UPoseInfo(UBridge * bridge_ptr, bool openlog)
 {
   bridge = bridge_ptr;
+  bridge->registerMessage("pse", this, [](UData * item, char * msg) { ((UPoseInfo*)item)->decode(msg); });
   if (openlog)
     openLog();
 }
@@ -54,9 +55,69 @@ void UPoseInfo::decode(char * msg)
   {
     UTime t;
     t.now();
-    fprintf(logfile, "%ld.%03ld %.3f %.3f %.4f\n", t.getSec(), t.getMilisec(), x, y, h);
+    logWriter.print(logfile, "%ld.%03ld %.3f %.3f %.4f\n", t.getSec(), t.getMilisec(), x, y, h);
   }
   updated();
+  if (telemetry.isOpen())
+    telemetry.add(URecorder::REC_POSE, dataTime, URecorder::RecPose{x, y, h});
+  // publish for other threads
+  Snapshot ps = {dataTime, x, y, h, tilt, dist};
+  snap.write(ps);
+  // and add to history
+  uint32_t n = historyCnt.load(std::memory_order_relaxed);
+  HistSample hs = {dataTime, x, y, h, n};
+  history[n % HISTORY_SIZE].write(hs);
+  historyCnt.store(n + 1, std::memory_order_release);
+}
+
+bool UPoseInfo::getHistory(uint32_t n, UPoseTime * pt)
+{
+  HistSample hs = history[n % HISTORY_SIZE].read();
+  if (hs.n != n)
+    // overwritten by a newer pose
+    return false;
+  UTime t;
+  t.setTime(hs.time);
+  pt->setPt(hs.x, hs.y, hs.h, t);
+  return true;
+}
+
+bool UPoseInfo::poseAt(UTime atTime, UPose * pose)
+{
+  uint32_t n = historyCnt.load(std::memory_order_acquire);
+  UPoseTime newer, older;
+  bool gotNewer = false;
+  bool isOK = false;
+  // the writer may be updating the oldest sample
+  uint32_t oldest = 0;
+  if (n > uint32_t(HISTORY_SIZE - 1))
+    oldest = n - (HISTORY_SIZE - 1);
+  // search back from newest pose
+  for (uint32_t k = n; k > oldest; k--)
+  {
+    if (not getHistory(k - 1, &older))
+      break;
+    if (older.t <= atTime)
+    { // found pose before (or at) time
+      if (not gotNewer)
+      { // time is after newest pose - extrapolate from the two newest
+        newer = older;
+        if (k - 1 <= oldest or not getHistory(k - 2, &older))
+          // just one pose
+          older = newer;
+      }
+      isOK = true;
+      break;
+    }
+    newer = older;
+    gotNewer = true;
+  }
+  if (isOK)
+    *pose = older.getPoseAtTime(newer, atTime);
+  else if (gotNewer)
+    // time is older than history, use oldest
+    *pose = newer.getPose();
+  return isOK;
 }
 
 void UPoseInfo::subscribe()
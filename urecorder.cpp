@@ -0,0 +1,186 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include "urecorder.h"
+#include "utime.h"
+
+URecorder telemetry;
+
+
+URecorder::~URecorder()
+{
+  close();
+}
+
+void URecorder::makeHeader(URecorder::FileHeader * header)
+{
+  memset(header, 0, sizeof(FileHeader));
+  strncpy(header->magic, "RBTELEM", 8);
+  header->version = VERSION;
+  header->typeCnt = REC_TYPE_CNT;
+  const struct {int size; const char * name; const char * fields;} types[REC_TYPE_CNT] = {
+    {0, "skip", ""},
+    {sizeof(RecPose),  "pose",  "x:f y:f h:f"},
+    {sizeof(RecImu),   "imu",   "accx:f accy:f accz:f gyrox:f gyroy:f gyroz:f"},
+    {sizeof(RecMotor), "motor", "vel1:f vel2:f cur1:f cur2:f"},
+    {sizeof(RecIr),    "ir",    "dist1:f dist2:f raw1:i raw2:i"},
+    {sizeof(RecEdge),  "edge",  "validLeft:i validRight:i crossingBlack:i crossingWhite:i"},
+    {sizeof(RecEvent), "event", "set:i cleared:i"},
+    {sizeof(RecAruco), "aruco", "frame:i id:i x:f y:f z:f distance:f angle:f vertical:i procTime:f"}
+  };
+  for (int i = 0; i < REC_TYPE_CNT; i++)
+  {
+    header->schema[i].type = i;
+    header->schema[i].size = types[i].size;
+    strncpy(header->schema[i].name, types[i].name, sizeof(header->schema[i].name) - 1);
+    strncpy(header->schema[i].fields, types[i].fields, sizeof(header->schema[i].fields) - 1);
+  }
+}
+
+bool URecorder::open(const char * name)
+{
+  close();
+  const int MNL = 128;
+  char fn[MNL];
+  if (name == NULL)
+  { // default name
+    const int MDL = 32;
+    char date[MDL];
+    UTime time;
+    time.now();
+    time.getForFilename(date);
+    snprintf(fn, MNL, "log_telemetry_%s.bin", date);
+    name = fn;
+  }
+  std::lock_guard<std::mutex> lock(addLock);
+  fd = ::open(name, O_RDWR | O_CREAT | O_TRUNC, 0664);
+  if (fd < 0)
+  {
+    perror(name);
+    return false;
+  }
+  if (not addSegment())
+  {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  makeHeader((FileHeader *)segment);
+  segmentUsed = sizeof(FileHeader);
+  recordCnt = 0;
+  opened = true;
+  printf("# URecorder:: recording telemetry to %s\n", name);
+  return true;
+}
+
+bool URecorder::addSegment()
+{
+  off_t start = off_t(segmentCnt) * SEGMENT_SIZE;
+  // allocate the disk space, so writes to the mapped segment can not fail
+  int err = posix_fallocate(fd, start, SEGMENT_SIZE);
+  if (err != 0)
+  {
+    errno = err;
+    perror("URecorder::addSegment");
+    return false;
+  }
+  void * p = mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, start);
+  if (p == MAP_FAILED)
+  {
+    perror("URecorder::addSegment mmap");
+    return false;
+  }
+  // finished segment is not needed any more
+  if (segment != NULL)
+    munmap(segment, SEGMENT_SIZE);
+  segment = (char *)p;
+  segmentCnt++;
+  segmentUsed = 0;
+  return true;
+}
+
+void URecorder::add(RecordType type, const timeval & t, const void * data, int size)
+{
+  // keep records 8-byte aligned
+  const int n = sizeof(RecHeader) + recordSpace(size);
+  std::lock_guard<std::mutex> lock(addLock);
+  if (not opened)
+    return;
+  if (segmentUsed + n > SEGMENT_SIZE)
+  { // the rest of this segment is zero (REC_SKIP)
+    if (not addSegment())
+    { // disk full? - keep what is recorded
+      closeLocked();
+      return;
+    }
+  }
+  char * p = segment + segmentUsed;
+  RecHeader * h = (RecHeader *)p;
+  h->sec = t.tv_sec;
+  h->usec = t.tv_usec;
+  h->type = type;
+  h->size = size;
+  memcpy(p + sizeof(RecHeader), data, size);
+  segmentUsed += n;
+  recordCnt++;
+}
+
+void URecorder::close()
+{
+  std::lock_guard<std::mutex> lock(addLock);
+  closeLocked();
+}
+
+void URecorder::closeLocked()
+{
+  opened = false;
+  if (fd >= 0)
+  {
+    off_t used = off_t(segmentCnt - 1) * SEGMENT_SIZE + segmentUsed;
+    if (segment != NULL)
+      munmap(segment, SEGMENT_SIZE);
+    segment = NULL;
+    segmentCnt = 0;
+    // remove unused part of last segment
+    if (ftruncate(fd, used) != 0)
+      perror("URecorder::close");
+    ::close(fd);
+    fd = -1;
+    printf("# URecorder:: closed telemetry recording (%u records, %ld bytes)\n", recordCnt, (long)used);
+  }
+}
+
+void URecorder::printStatus()
+{
+  std::lock_guard<std::mutex> lock(addLock);
+  printf("# ------- Telemetry recorder ----------\n");
+  if (opened)
+    printf("# recording: %u records, %.1f MB\n", recordCnt, 
+           ((segmentCnt - 1) * double(SEGMENT_SIZE) + segmentUsed) / 1e6);
+  else
+    printf("# recording: not active\n");
+}
@@ -0,0 +1,147 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef URECORDER_H
+#define URECORDER_H
+
+#include <stdint.h>
+#include <sys/time.h>
+#include <atomic>
+#include <mutex>
+
+/**
+ * Binary telemetry recorder.
+ * Records from all data types are appended to one memory mapped file
+ * (log_telemetry_<date>.bin), each as a small header and a fixed layout record.
+ * This is much cheaper than the text logs, and the
+ * telemetry2txt tool converts the file to the text logfile formats.
+ *
+ * File layout:
+ * - FileHeader (schema with size and field names for each record type)
+ * - records: RecHeader followed by 'size' bytes of record data,
+ *   padded to a multiple of 8 bytes.
+ * The file is mapped in segments of SEGMENT_SIZE bytes, a record is never split
+ * between segments, a type of REC_SKIP (0) means continue at next segment.
+ * Only the segment in use is mapped, and disk space is allocated for the whole
+ * segment when it is mapped, so a full disk stops the recording. */
+class URecorder
+{
+public:
+  enum RecordType {REC_SKIP = 0, REC_POSE, REC_IMU, REC_MOTOR, REC_IR, 
+                   REC_EDGE, REC_EVENT, REC_ARUCO, REC_TYPE_CNT};
+  /// size of each mapped part of the file
+  static const int SEGMENT_SIZE = 4 * 1024 * 1024;
+  static const uint32_t VERSION = 1;
+  /** header for each record */
+  struct RecHeader
+  {
+    int64_t sec;
+    int32_t usec;
+    uint16_t type;
+    uint16_t size;
+  };
+  // record layouts - fields in same order as in the text logfiles
+  struct RecPose {float x, y, h;};
+  struct RecImu {float acc[3]; float gyro[3];};
+  struct RecMotor {float velocity[2]; float current[2];};
+  struct RecIr {float dist[2]; int32_t raw[2];};
+  struct RecEdge {int32_t validLeft, validRight, crossingBlack, crossingWhite;};
+  /** event set or cleared (the other is -1) */
+  struct RecEvent {int32_t set, cleared;};
+  struct RecAruco {int32_t frame, id; float x, y, z, distance, angle; int32_t vertical; float procTime;};
+  /** description of one record type */
+  struct Schema
+  {
+    uint16_t type;
+    uint16_t size;
+    char name[12];
+    /// field names and type (f=float, i=int32), e.g. "x:f h:f raw1:i"
+    char fields[112];
+  };
+  /** start of file */
+  struct FileHeader
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t typeCnt;
+    Schema schema[REC_TYPE_CNT];
+  };
+  /** destructor - closes the file */
+  ~URecorder();
+  /**
+   * Open a new recording
+   * \param name is the filename, if NULL, then log_telemetry_<date>.bin is used.
+   * \returns true if opened */
+  bool open(const char * name = NULL);
+  /**
+   * Stop recording and truncate file to used size */
+  void close();
+  /** is recording active */
+  inline bool isOpen()
+  {
+    return opened.load(std::memory_order_relaxed);
+  }
+  /**
+   * Add a record (copied into the mapped file).
+   * \param type is the record type
+   * \param t is the timestamp for the data
+   * \param data is the record of the type given
+   * \param size is the size of the record */
+  void add(RecordType type, const timeval & t, const void * data, int size);
+  /** add a record of any of the defined types */
+  template <class T>
+  inline void add(RecordType type, const timeval & t, const T & data)
+  {
+    add(type, t, &data, sizeof(T));
+  }
+  /** print recorded size */
+  void printStatus();
+  /** space used by a record in the file (record size rounded up to 8 bytes) */
+  static inline int recordSpace(int size)
+  {
+    return (size + 7) & ~7;
+  }
+  /** fill in the schema for all types */
+  static void makeHeader(FileHeader * header);
+
+private:
+  /** map the next segment of the file (and unmap the finished segment) */
+  bool addSegment();
+  /** truncate to used size and close the file (addLock must be locked) */
+  void closeLocked();
+  int fd = -1;
+  std::atomic<bool> opened = {false};
+  /** the mapped segment, used for new records */
+  char * segment = NULL;
+  /** number of segments in file (including the mapped) */
+  int segmentCnt = 0;
+  /** write position in mapped segment */
+  int segmentUsed = 0;
+  /** number of records written */
+  uint32_t recordCnt = 0;
+  /** lock for write position (records may come from any thread) */
+  std::mutex addLock;
+};
+
+/** telemetry recorder used by all data items */
+extern URecorder telemetry;
+
+#endif
@@ -0,0 +1,76 @@
+/***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+
+#ifndef USEQLOCK_H
+#define USEQLOCK_H
+
+#include <atomic>
+#include <string.h>
+#include <stdint.h>
+
+/**
+ * Sequence lock for a small data structure with one writer
+ * (the bridge receive thread) and any number of readers.
+ * The writer never waits, a reader retries if the data was
+ * updated while it was copied, so a reader never sees
+ * a mix of old and new values.
+ * T must be a plain struct (copied with memcpy). */
+template <class T>
+class USeqLock
+{
+public:
+  /**
+   * Publish a new value (from one thread only) */
+  void write(const T & value)
+  {
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    // odd sequence number while writing
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&data, &value, sizeof(T));
+    seq.store(s + 2, std::memory_order_release);
+  }
+  /**
+   * Get a consistent copy of the latest value */
+  T read() const
+  {
+    T value;
+    uint32_t s1, s2;
+    do
+    {
+      s1 = seq.load(std::memory_order_acquire);
+      memcpy(&value, &data, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      s2 = seq.load(std::memory_order_relaxed);
+    } while ((s1 & 1) != 0 or s1 != s2);
+    return value;
+  }
+  /**
+   * Number of updates since start */
+  inline uint32_t getUpdateCnt() const
+  {
+    return seq.load(std::memory_order_relaxed) / 2;
+  }
+private:
+  std::atomic<uint32_t> seq = {0};
+  T data = {};
+};
+
+#endif
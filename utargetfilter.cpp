@@ -0,0 +1,108 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <math.h>
+#include "utargetfilter.h"
+
+
+void UPoseFilter::reset()
+{
+  estimate = pose_t();
+  confidence = 0;
+  hitCnt = 0;
+  hits = 0;
+  deviation = 0;
+  lastFrame = -1;
+}
+
+const pose_t & UPoseFilter::update(const pose_t & m, int frame, UTime t)
+{
+  if (frame == lastFrame)
+    // used already
+    return estimate;
+  if (lastFrame >= 0 and t - lastTime > maxAge)
+    reset();
+  lastFrame = frame;
+  lastTime = t;
+  hits = hits * (1 - alpha) + (m.valid ? alpha : 0);
+  if (m.valid)
+  {
+    if (not estimate.valid)
+      estimate = m;
+    else
+    {
+      float d = hypot(m.x - estimate.x, m.y - estimate.y);
+      deviation = deviation * (1 - alpha) + d * alpha;
+      estimate.x += alpha * (m.x - estimate.x);
+      estimate.y += alpha * (m.y - estimate.y);
+      estimate.z += alpha * (m.z - estimate.z);
+      estimate.radius = lround(estimate.radius + alpha * (m.radius - estimate.radius));
+      estimate.id = m.id;
+    }
+    hitCnt++;
+  }
+  confidence = hits * tolerance / (tolerance + deviation);
+  return estimate;
+}
+
+/////////////////////////////////////////////////////////
+
+void UVoteFilter::reset()
+{
+  for (int i = 0; i < MAX_CLASSES; i++)
+    score[i] = 0;
+  best = -1;
+  confidence = 0;
+  voteCnt = 0;
+  lastFrame = -1;
+}
+
+int UVoteFilter::update(int vote, int frame, UTime t)
+{
+  if (frame == lastFrame)
+    // used already
+    return best;
+  if (lastFrame >= 0 and t - lastTime > maxAge)
+    reset();
+  lastFrame = frame;
+  lastTime = t;
+  if (classes > MAX_CLASSES)
+    classes = MAX_CLASSES;
+  if (vote < 0 or vote >= classes)
+    // no vote, nothing new
+    return best;
+  // log likelihood of this vote for each class
+  const float right = log(accuracy);
+  const float wrong = log((1 - accuracy) / (classes - 1));
+  for (int i = 0; i < classes; i++)
+    score[i] = score[i] * decay + (i == vote ? right : wrong);
+  voteCnt++;
+  best = 0;
+  for (int i = 1; i < classes; i++)
+    if (score[i] > score[best])
+      best = i;
+  // probability of best class
+  float sum = 0;
+  for (int i = 0; i < classes; i++)
+    sum += exp(score[i] - score[best]);
+  confidence = 1 / sum;
+  return best;
+}
@@ -0,0 +1,112 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UTARGETFILTER_H
+#define UTARGETFILTER_H
+
+#include <stdio.h>
+#include "types.h"
+#include "utime.h"
+
+/**
+ * Filtered position of one target over frames (exponential average).
+ * Each frame gives one measurement (valid or not), the confidence (0..1)
+ * grows with the rate of valid measurements and falls with the
+ * variation of the measured position.
+ * Each frame is used once only (by frame number), and the state is reset
+ * if the last measurement is older than maxAge. */
+class UPoseFilter
+{
+public:
+  /// weight of a new measurement (0..1)
+  float alpha = 0.4;
+  /// position variation (in units of x and y) that halves the confidence
+  float tolerance = 10;
+  /// a state older than this (seconds) is reset
+  float maxAge = 1.0;
+  /// filtered target, valid if seen since reset
+  pose_t estimate = pose_t();
+  /// confidence of estimate (0..1)
+  float confidence = 0;
+  /// valid measurements since reset
+  int hitCnt = 0;
+public:
+  /**
+   * Forget the target (e.g. after the robot has moved) */
+  void reset();
+  /**
+   * Add a measurement from a new frame
+   * \param m is the detection (also if not valid)
+   * \param frame is the frame number, a frame already used is ignored
+   * \param t is the capture time of the frame
+   * \returns the filtered estimate */
+  const pose_t & update(const pose_t & m, int frame, UTime t);
+private:
+  /// average of valid (1) and missing (0) measurements
+  float hits = 0;
+  /// average distance from measurement to estimate
+  float deviation = 0;
+  int lastFrame = -1;
+  UTime lastTime;
+};
+
+/**
+ * Classification of one target from votes over frames.
+ * Each vote is taken as right with probability 'accuracy', and older
+ * votes count less (decay), the confidence is the probability of
+ * the best class given the votes. */
+class UVoteFilter
+{
+public:
+  static const int MAX_CLASSES = 8;
+  /// number of classes (votes are 0 .. classes-1)
+  int classes = 2;
+  /// probability that a single vote is right
+  float accuracy = 0.8;
+  /// weight of the votes so far when a new vote is added (0..1)
+  float decay = 0.9;
+  /// a state older than this (seconds) is reset
+  float maxAge = 1.0;
+  /// best class, -1 if no votes
+  int best = -1;
+  /// probability of best class (0..1)
+  float confidence = 0;
+  /// votes since reset
+  int voteCnt = 0;
+public:
+  /**
+   * Forget the votes */
+  void reset();
+  /**
+   * Add a vote from a new frame
+   * \param vote is the class, a value outside 0 .. classes-1 is no vote
+   * \param frame is the frame number, a frame already used is ignored
+   * \param t is the capture time of the frame
+   * \returns best class (-1 if no votes) */
+  int update(int vote, int frame, UTime t);
+private:
+  /// log likelihood for each class
+  float score[MAX_CLASSES] = {0};
+  int lastFrame = -1;
+  UTime lastTime;
+};
+
+#endif
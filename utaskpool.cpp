@@ -0,0 +1,108 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include "utaskpool.h"
+
+
+UTaskPool::~UTaskPool()
+{
+  stop();
+}
+
+void UTaskPool::start(int threads)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  stopping = false;
+  for (int i = workers.size(); i < threads; i++)
+    workers.push_back(new std::thread(&UTaskPool::run, this));
+}
+
+void UTaskPool::stop()
+{
+  wait();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  hasJob.notify_all();
+  for (std::thread * t : workers)
+  {
+    t->join();
+    delete t;
+  }
+  workers.clear();
+}
+
+void UTaskPool::add(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    jobs.push_back(job);
+  }
+  hasJob.notify_one();
+}
+
+void UTaskPool::wait()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true)
+  {
+    if (not jobs.empty())
+    { // help with waiting jobs
+      std::function<void()> job = jobs.front();
+      jobs.pop_front();
+      busy++;
+      guard.unlock();
+      job();
+      guard.lock();
+      busy--;
+    }
+    else if (busy == 0)
+      break;
+    else
+      allDone.wait(guard);
+  }
+}
+
+void UTaskPool::run()
+{
+  while (true)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      hasJob.wait(guard, [this]{ return stopping or not jobs.empty(); });
+      if (jobs.empty())
+        // stopping
+        break;
+      job = jobs.front();
+      jobs.pop_front();
+      busy++;
+    }
+    job();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      busy--;
+      if (busy == 0 and jobs.empty())
+        allDone.notify_all();
+    }
+  }
+}
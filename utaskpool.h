@@ -0,0 +1,76 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UTASKPOOL_H
+#define UTASKPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * Small pool of worker threads for independent jobs on the same data
+ * (e.g. several detectors on one camera frame).
+ * Jobs are added with add(), and wait() returns when all are finished.
+ * The thread calling wait() runs waiting jobs too, so with no
+ * worker threads all jobs are run (in order) by wait(). */
+class UTaskPool
+{
+public:
+  /** destructor - stops worker threads */
+  ~UTaskPool();
+  /**
+   * Start worker threads (if not started already)
+   * \param threads is number of worker threads */
+  void start(int threads);
+  /**
+   * Stop worker threads, waiting jobs are finished first */
+  void stop();
+  /**
+   * Add a job, it may start at once in a worker thread.
+   * Data used by the job must not be changed before wait() returns */
+  void add(std::function<void()> job);
+  /**
+   * Run waiting jobs and return when all added jobs are finished */
+  void wait();
+  /**
+   * Number of worker threads */
+  int threadCnt()
+  {
+    return workers.size();
+  }
+private:
+  /** worker thread */
+  void run();
+  std::deque<std::function<void()> > jobs;
+  std::vector<std::thread *> workers;
+  std::mutex lock;
+  std::condition_variable hasJob;
+  std::condition_variable allDone;
+  /// jobs started, but not finished
+  int busy = 0;
+  bool stopping = false;
+};
+
+#endif
@@ -0,0 +1,155 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#include <opencv2/imgproc.hpp>
+#include "uvideorecorder.h"
+#include "utime.h"
+
+
+UVideoRecorder::~UVideoRecorder()
+{
+  close();
+}
+
+bool UVideoRecorder::open(const char * basename, cv::Size size, double fps)
+{
+  close();
+  if (subsample < 1)
+    subsample = 1;
+  recSize = cv::Size(size.width / subsample, size.height / subsample);
+  filename = basename;
+  if (format == VIDEO_YUV)
+  { // 4:2:0 needs an even size
+    recSize.width &= ~1;
+    recSize.height &= ~1;
+    filename += ".yuv";
+    yuv = fopen(filename.c_str(), "w");
+    if (yuv == NULL)
+    {
+      perror(filename.c_str());
+      return false;
+    }
+    printf("# UVideoRecorder: encode with: ffmpeg -f rawvideo -pix_fmt yuv420p -s %dx%d -r %g -i %s %s.mp4\n",
+           recSize.width, recSize.height, fps / frameInterval, filename.c_str(), basename);
+  }
+  else
+  {
+    filename += ".avi";
+    if (not writer.open(filename, cv::VideoWriter::fourcc('M','J','P','G'), fps / frameInterval, recSize, true))
+    {
+      printf("# UVideoRecorder: failed to open %s\n", filename.c_str());
+      return false;
+    }
+  }
+  frameCnt = 0;
+  stopping = false;
+  th = new std::thread(&UVideoRecorder::run, this);
+  return true;
+}
+
+void UVideoRecorder::close()
+{
+  if (th == NULL)
+    return;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  hasFrame.notify_all();
+  th->join();
+  delete th;
+  th = NULL;
+  if (yuv != NULL)
+  {
+    fclose(yuv);
+    yuv = NULL;
+  }
+  writer.release();
+}
+
+bool UVideoRecorder::add(const cv::Mat & frame)
+{
+  if (th == NULL)
+    return false;
+  if (frameInterval > 1 and frameCnt++ % frameInterval != 0)
+    // not to be recorded
+    return true;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if ((int)frames.size() >= maxQueue)
+    { // never wait for the disk
+      dropCnt++;
+      return false;
+    }
+  }
+  // copy outside the lock, the recorder thread may be busy with the queue
+  cv::Mat copy;
+  if (subsample > 1)
+    cv::resize(frame(cv::Rect(0, 0, recSize.width * subsample, recSize.height * subsample)),
+               copy, recSize, 0, 0, cv::INTER_NEAREST);
+  else
+    frame(cv::Rect(0, 0, recSize.width, recSize.height)).copyTo(copy);
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    frames.push_back(copy);
+  }
+  hasFrame.notify_one();
+  return true;
+}
+
+void UVideoRecorder::run()
+{
+  UTime t;
+  cv::Mat i420;
+  while (true)
+  {
+    cv::Mat frame;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      hasFrame.wait(guard, [this]{ return stopping or not frames.empty(); });
+      if (frames.empty())
+        // stopping and all written
+        break;
+      frame = frames.front();
+      frames.pop_front();
+    }
+    t.now();
+    if (yuv != NULL)
+    {
+      cv::cvtColor(frame, i420, cv::COLOR_BGR2YUV_I420);
+      if (fwrite(i420.data, 1, i420.total(), yuv) != i420.total())
+        printf("# UVideoRecorder: failed to write %s\n", filename.c_str());
+    }
+    else
+      writer.write(frame);
+    std::lock_guard<std::mutex> guard(lock);
+    recordedCnt++;
+    writeMs = (writeMs * 7 + t.getTimePassed() * 1000) / 8;
+  }
+}
+
+void UVideoRecorder::printStatus()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  printf("# video recorder: %s (%dx%d, every %d frame), %d recorded, %d dropped, %d waiting, write %.1f ms\n",
+         filename.c_str(), recSize.width, recSize.height, frameInterval,
+         recordedCnt, dropCnt, (int)frames.size(), writeMs);
+}
@@ -0,0 +1,106 @@
+ /***************************************************************************
+ *   Copyright (C) 2016-2020 by DTU (Christian Andersen)                        *
+ *   jca@elektro.dtu.dk                                                    *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU Lesser General Public License as        *
+ *   published by the Free Software Foundation; either version 2 of the    *
+ *   License, or (at your option) any later version.                       *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU Lesser General Public License for more details.                   *
+ *                                                                         *
+ *   You should have received a copy of the GNU Lesser General Public      *
+ *   License along with this program; if not, write to the                 *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+ 
+
+#ifndef UVIDEORECORDER_H
+#define UVIDEORECORDER_H
+
+#include <stdio.h>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio.hpp>
+
+/**
+ * Video recording from a background thread, so encoding and
+ * flash write do not delay the detectors.
+ * Frames are copied (and possibly subsampled) into a bounded queue,
+ * if the queue is full the frame is dropped (and counted) rather than waiting.
+ * Frames can be MJPG encoded (.avi), or written as raw YUV 4:2:0 (.yuv)
+ * to be encoded later, e.g.
+ * ffmpeg -f rawvideo -pix_fmt yuv420p -s 466x350 -r 10 -i video.yuv video.mp4 */
+class UVideoRecorder
+{
+public:
+  enum VideoFormat {
+    VIDEO_MJPG,   ///< encoded in the recorder thread (slow)
+    VIDEO_YUV     ///< raw I420 frames (fast, 1.5 bytes per pixel)
+  };
+  /// file format (set before open())
+  VideoFormat format = VIDEO_MJPG;
+  /// keep every n'th pixel in both directions (1 is full size)
+  int subsample = 1;
+  /// record every n'th frame only
+  int frameInterval = 1;
+  /// max number of frames waiting to be written
+  int maxQueue = 8;
+public:
+  /** destructor - writes waiting frames and closes file */
+  ~UVideoRecorder();
+  /**
+   * Open video file and start recorder thread
+   * \param basename is filename without extension, the extension is added from format
+   * \param size is frame size (before subsample)
+   * \param fps is frame rate saved in the file
+   * \returns false if file could not be opened */
+  bool open(const char * basename, cv::Size size, double fps);
+  /**
+   * Write waiting frames, stop recorder thread and close file */
+  void close();
+  /**
+   * Add a frame, the frame is copied, so it may be changed when this returns
+   * \param frame is 8-bit BGR image of the size given to open()
+   * \returns false if the frame is dropped (queue full or not open) */
+  bool add(const cv::Mat & frame);
+  /**
+   * Is a file open */
+  bool isOpen()
+  {
+    return th != NULL;
+  }
+  /**
+   * print status (one line) */
+  void printStatus();
+  /// frames written and dropped
+  int recordedCnt = 0;
+  int dropCnt = 0;
+private:
+  /** recorder thread */
+  void run();
+  std::string filename;
+  /// size of recorded frames (after subsample)
+  cv::Size recSize;
+  cv::VideoWriter writer;
+  FILE * yuv = NULL;
+  std::deque<cv::Mat> frames;
+  std::thread * th = NULL;
+  std::mutex lock;
+  std::condition_variable hasFrame;
+  bool stopping = false;
+  /// frames offered to add()
+  int frameCnt = 0;
+  /// average write time (ms)
+  float writeMs = 0;
+};
+
+#endif